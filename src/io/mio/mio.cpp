@@ -24,8 +24,7 @@ License : New BSD
  *
  */
 
-#include <dos.h>
-#include <conio.h>
+#include "../pio/pio.h"
 #include "mio.h"
 
 
@@ -107,6 +106,15 @@ void get_di_val(int slot, int *val)
     *val ^= dio_val[slot];
 }
 
+/*!
+ * Returns the last values of the channels of the DO module in slot \a slot,
+ * as they were set by set_do_bit() (the module registers can not be read).
+ */
+void get_do_val(int slot, int *val)
+{
+    *val = (8 > slot) ? (dio_val[slot]) : (0);
+}
+
 /*! 
  */
 void set_do_bit(int slot, int bit, int val)
@@ -25,6 +25,7 @@ extern "C" {
 #endif
 
 void get_di_val(int slot, int *val);
+void get_do_val(int slot, int *val);
 void set_do_bit(int slot, int bit, int val);
 
 #ifdef __cplusplus
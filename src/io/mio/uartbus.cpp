@@ -14,7 +14,7 @@ License : New BSD
  *
  */
 
-#include <conio.h>
+#include "../pio/pio.h"
 #include "uartbus.h"
 
 
@@ -0,0 +1,1119 @@
+/*********************************************************************************************
+Project :
+Version :
+Date    : 17.10.2026
+Author  :
+Company :
+Comments: A library for work with the Modbus RTU protocol in your controllers ADAM 5000 series.
+License : New BSD
+**********************************************************************************************/
+
+/*! \file modbus.cpp
+ *
+ * This module implements the Modbus RTU master and slave over the serial ports of the module "sio".
+ *
+ * The frames are received in the framing mode of "sio" (the pause of 3.5 characters)
+ * with the CRC computed by the ISR, and they are sent by sio_send_crc().
+ * The master works as a state machine, it is driven by modbus_master_poll()
+ * and never waits. When the response is accepted, the next request is sent
+ * at once, and only then the completion callbacks are called, so the processing
+ * of the caller overlaps the transfer of the next transaction.
+ *
+ * The slave serves the coils and the discrete inputs directly from the state
+ * of the local DO and DI modules of the module "mio", and the holding registers
+ * from the table of the caller. The request is served by the ISR of the port
+ * when it closes the frame (the event SIO_EV_FRAME of sio_set_rx_notify()),
+ * and the response is encoded directly into the output queue (sio_tx_reserve()),
+ * so the time of the response does not depend on the scan time of the main loop.
+ * Only the writes of the coils are deferred: set_do_bit() is not safe
+ * at the interrupt level, so the ISR keeps the written values (the reads
+ * of the coils return them at once) and modbus_slave_poll() writes them
+ * to the DO modules.
+ */
+
+#include "modbus.h"
+#include "../mio/mio.h"
+
+#include <string.h>
+
+
+//--------------------------------------------------------------------------------------------------------//
+/*** Private enums and structures ***/
+
+/*!
+ * States of the master.
+ */
+typedef enum MODBUS_STATE {
+    STATE_IDLE      = 0, /*!< No transaction. */
+    STATE_SEND      = 1, /*!< The request is ready, waits for the space in the output queue. */
+    STATE_WAIT      = 2, /*!< The request is sent, waits for the response. */
+    STATE_BROADCAST = 3  /*!< The broadcast request is sent, waits while the slaves process it. */
+} modbus_state_t;
+
+/*!
+ * Size of the frame without the data: address, function and CRC.
+ */
+enum {
+    FRAME_HEADER = 2,
+    FRAME_CRC = 2
+};
+
+/*!
+ * Number of the slots of the I/O modules.
+ */
+enum {
+    SLOTS = MODBUS_SLOTS
+};
+
+/*!
+ * Writer of the response of the slave to the free space of the output queue.
+ */
+typedef struct MODBUS_WRITER {
+    char *ptr1; /*!< First region of the free space. */
+    int len1;   /*!< Length of the first region. */
+    char *ptr2; /*!< Second region of the free space (the beginning of the ring buffer). */
+    int len2;   /*!< Length of the second region. */
+    int pos;    /*!< Number of the written bytes. */
+} modbus_writer_t;
+
+
+//--------------------------------------------------------------------------------------------------------//
+/*** Global variables ***/
+
+/*!
+ * This variable contains the error code of the last function call.
+ */
+int modbuserrno = MODBUS_ERR_NONE;
+
+/*!
+ * Slaves by the port number, for the RX notification.
+ */
+static modbus_slave_t *port_slaves[4] = {0, 0, 0, 0};
+
+
+//--------------------------------------------------------------------------------------------------------//
+/*** Private functions ***/
+
+/*!
+ * Writes the word \a v to \a p, the high byte first.
+ */
+static void put16(char *p, u16 v)
+{
+    p[0] = (char)(v >> 8);
+    p[1] = (char)v;
+}
+
+/*!
+ * Reads the word from \a p, the high byte first.
+ */
+static u16 get16(const char *p)
+{
+    return (u16)(((u16)(u8)p[0] << 8) | (u8)p[1]);
+}
+
+/*!
+ * Returns not 0 if \a function reads the data.
+ */
+static int is_read(int function)
+{
+    return ((function >= MODBUS_READ_COILS) && (function <= MODBUS_READ_INPUT_REGISTERS));
+}
+
+/*!
+ * Returns not 0 if \a function works with the coils or the inputs.
+ */
+static int is_bits(int function)
+{
+    return ((MODBUS_READ_COILS == function) || (MODBUS_READ_DISCRETE_INPUTS == function)
+            || (MODBUS_WRITE_SINGLE_COIL == function) || (MODBUS_WRITE_MULTIPLE_COILS == function));
+}
+
+/*!
+ * Checks the request \a req.
+ * \param req Pointer to the request.
+ * \return Not 0 if the request is valid.
+ */
+static int request_check(const modbus_request_t *req)
+{
+    if ((req->slave > 247) || (!req->count) || (((u32)req->address + req->count) > 0x10000UL)) {
+        return 0;
+    }
+    if (is_read(req->function) && (MODBUS_BROADCAST == req->slave)) {
+        return 0; // There is no response.
+    }
+    switch (req->function) {
+    case MODBUS_READ_COILS:
+    case MODBUS_READ_DISCRETE_INPUTS:
+        return (req->bits && (req->count <= MODBUS_READ_BITS_MAX));
+    case MODBUS_READ_HOLDING_REGISTERS:
+    case MODBUS_READ_INPUT_REGISTERS:
+        return (req->regs && (req->count <= MODBUS_READ_REGS_MAX));
+    case MODBUS_WRITE_SINGLE_COIL:
+        return (req->bits && (1 == req->count));
+    case MODBUS_WRITE_SINGLE_REGISTER:
+        return (req->regs && (1 == req->count));
+    case MODBUS_WRITE_MULTIPLE_COILS:
+        return (req->bits && (req->count <= MODBUS_WRITE_BITS_MAX));
+    case MODBUS_WRITE_MULTIPLE_REGISTERS:
+        return (req->regs && (req->count <= MODBUS_WRITE_REGS_MAX));
+    default:
+        return 0;
+    }
+}
+
+/*!
+ * Looks for the own settings of \a slave of master \a m.
+ * \return Index in the table of the slaves or -1.
+ */
+static int slave_find(const modbus_master_t *m, u8 slave)
+{
+    for (int i = 0; i < m->slaves_cnt; ++i) {
+        if (slave == m->slaves[i].slave) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*!
+ * Takes the first request from the queue of master \a m as the new transaction.
+ *
+ * The reads of the same slave and function, whose ranges overlap or adjoin the range
+ * of the transaction, are merged into it while the transaction fits into one frame.
+ * A later read is not merged over a write to the same slave, so the order of
+ * the reads and the writes of one slave is kept.
+ * \param m Pointer to the master.
+ */
+static void queue_take(modbus_master_t *m)
+{
+    modbus_request_t *req = m->queue[0];
+    m->queue[0] = 0;
+    m->active[0] = req;
+    m->active_cnt = 1;
+
+    u32 lo = req->address;
+    u32 hi = lo + req->count;
+
+    if (is_read(req->function)) {
+        u32 limit = (is_bits(req->function)) ? (MODBUS_READ_BITS_MAX) : (MODBUS_READ_REGS_MAX);
+        int grown = 1;
+        while (grown && (m->active_cnt < MODBUS_COALESCE_MAX)) {
+            grown = 0;
+            for (int i = 1; (i < m->queued) && (m->active_cnt < MODBUS_COALESCE_MAX); ++i) {
+                modbus_request_t *r = m->queue[i];
+                if ((!r) || (r->slave != req->slave)) {
+                    continue;
+                }
+                if (!is_read(r->function)) {
+                    break;
+                }
+                if (r->function != req->function) {
+                    continue;
+                }
+                u32 rlo = r->address;
+                u32 rhi = rlo + r->count;
+                if ((rlo > hi) || (rhi < lo)) { // Not adjoined?
+                    continue;
+                }
+                u32 nlo = (rlo < lo) ? (rlo) : (lo);
+                u32 nhi = (rhi > hi) ? (rhi) : (hi);
+                if ((nhi - nlo) > limit) {
+                    continue;
+                }
+                lo = nlo;
+                hi = nhi;
+                m->active[m->active_cnt++] = r;
+                m->queue[i] = 0;
+                m->stats.coalesced++;
+                grown = 1;
+            }
+        }
+    }
+
+    // Remove the taken requests, the order of others remains.
+    int n = 0;
+    for (int i = 0; i < m->queued; ++i) {
+        if (m->queue[i]) {
+            m->queue[n++] = m->queue[i];
+        }
+    }
+    m->queued = n;
+
+    m->slave = req->slave;
+    m->function = req->function;
+    m->address = (u16)lo;
+    m->count = (u16)(hi - lo);
+
+    int i = slave_find(m, m->slave);
+    m->tries = (-1 == i) ? (m->retries) : (m->slaves[i].retries);
+    m->wait_ms = (-1 == i) ? (m->timeout_ms) : (m->slaves[i].timeout_ms);
+}
+
+/*!
+ * Encodes the request of the transaction of master \a m to \a adu.
+ * \param m Pointer to the master.
+ */
+static void request_encode(modbus_master_t *m)
+{
+    const modbus_request_t *req = m->active[0];
+    char *p = m->adu;
+    int n;
+
+    p[0] = (char)m->slave;
+    p[1] = (char)m->function;
+    put16(p + 2, m->address);
+
+    switch (m->function) {
+    case MODBUS_WRITE_SINGLE_COIL:
+        put16(p + 4, (1 & req->bits[0]) ? (0xFF00) : (0x0000));
+        m->len = 6;
+        break;
+    case MODBUS_WRITE_SINGLE_REGISTER:
+        put16(p + 4, req->regs[0]);
+        m->len = 6;
+        break;
+    case MODBUS_WRITE_MULTIPLE_COILS:
+        put16(p + 4, m->count);
+        n = (m->count + 7) / 8;
+        p[6] = (char)n;
+        memcpy(p + 7, req->bits, n);
+        if (m->count & 7) { // The unused bits of the last byte are 0.
+            p[6 + n] &= (char)((1 << (m->count & 7)) - 1);
+        }
+        m->len = 7 + n;
+        break;
+    case MODBUS_WRITE_MULTIPLE_REGISTERS:
+        put16(p + 4, m->count);
+        p[6] = (char)(m->count * 2);
+        for (n = 0; n < m->count; ++n) {
+            put16(p + 7 + (n * 2), req->regs[n]);
+        }
+        m->len = 7 + (m->count * 2);
+        break;
+    default: // Reads.
+        put16(p + 4, m->count);
+        m->len = 6;
+        break;
+    }
+
+    // Transfer time of the request, 11 bits per character.
+    u32 bps = sio_get_baud(m->nport, 0);
+    m->tx_ms = (bps) ? ((u16)(((u32)(m->len + FRAME_CRC) * 11000UL) / bps + 1)) : (0);
+}
+
+/*!
+ * Sends the request of the transaction of master \a m, if it fits into the output queue.
+ * \param m Pointer to the master.
+ * \return -1 on error of the port, 0 if the request is not sent yet, 1 if it is sent.
+ */
+static int request_send(modbus_master_t *m)
+{
+    // The frames received before the request are not the response.
+    sio_clear(m->nport, SIO_RX_DIRECTION);
+
+    int r = sio_send_crc(m->nport, m->adu, m->len);
+    if (r <= 0) {
+        return r;
+    }
+
+    m->stats.transactions++;
+    if (MODBUS_BROADCAST == m->slave) {
+        tio_deadline(&m->deadline, (u32)m->tx_ms + MODBUS_BROADCAST_MS);
+        m->state = STATE_BROADCAST;
+    } else {
+        tio_deadline(&m->deadline, (u32)m->tx_ms + m->wait_ms);
+        m->state = STATE_WAIT;
+    }
+    return 1;
+}
+
+/*!
+ * Checks the frame \a buf of length \a len (without the CRC) received
+ * by master \a m as the response of the transaction.
+ * \param m Pointer to the master.
+ * \param buf A pointer to the frame.
+ * \param len Length of the frame without the CRC.
+ * \return -1 if the frame is not the response, else the result as modbus_error_t.
+ */
+static int response_check(modbus_master_t *m, const char *buf, int len)
+{
+    if ((len < FRAME_HEADER + 1) || (m->slave != (u8)buf[0])) {
+        m->stats.ignored++;
+        return -1;
+    }
+
+    if ((m->function | 0x80) == (u8)buf[1]) {
+        if ((FRAME_HEADER + 1) != len) {
+            return MODBUS_ERR_INVALID_RESPONSE;
+        }
+        for (int i = 0; i < m->active_cnt; ++i) {
+            m->active[i]->exception = (u8)buf[2];
+        }
+        m->stats.exceptions++;
+        return MODBUS_ERR_EXCEPTION;
+    }
+
+    if (m->function != (u8)buf[1]) {
+        return MODBUS_ERR_INVALID_RESPONSE;
+    }
+
+    int n;
+    switch (m->function) {
+    case MODBUS_READ_COILS:
+    case MODBUS_READ_DISCRETE_INPUTS:
+        n = (m->count + 7) / 8;
+        break;
+    case MODBUS_READ_HOLDING_REGISTERS:
+    case MODBUS_READ_INPUT_REGISTERS:
+        n = m->count * 2;
+        break;
+    default: // Writes return the address and the value or the number.
+        return ((6 == len) && (!memcmp(buf, m->adu, 6))) ? (MODBUS_ERR_NONE) : (MODBUS_ERR_INVALID_RESPONSE);
+    }
+    return ((n == (u8)buf[2]) && ((FRAME_HEADER + 1 + n) == len)) ? (MODBUS_ERR_NONE) : (MODBUS_ERR_INVALID_RESPONSE);
+}
+
+/*!
+ * Copies the data of the read response \a buf to the requests of the transaction of master \a m.
+ * \param m Pointer to the master.
+ * \param buf A pointer to the response.
+ */
+static void response_decode(modbus_master_t *m, const char *buf)
+{
+    const char *data = buf + FRAME_HEADER + 1;
+    for (int k = 0; k < m->active_cnt; ++k) {
+        modbus_request_t *r = m->active[k];
+        u16 off = r->address - m->address;
+        u16 i;
+        if (is_bits(m->function)) {
+            memset(r->bits, 0, (r->count + 7) / 8);
+            for (i = 0; i < r->count; ++i) {
+                u16 bit = off + i;
+                if ((data[bit >> 3] >> (bit & 7)) & 1) {
+                    r->bits[i >> 3] |= (u8)(1 << (i & 7));
+                }
+            }
+        } else {
+            for (i = 0; i < r->count; ++i) {
+                r->regs[i] = get16(data + ((off + i) * 2));
+            }
+        }
+    }
+}
+
+/*!
+ * Finishes the transaction of master \a m with \a error and moves its requests
+ * to \a finished; the callbacks are called later by the caller.
+ * \param m Pointer to the master.
+ * \param error Result as modbus_error_t.
+ * \param finished Array of the finished requests.
+ * \return Number of the finished requests.
+ */
+static int transaction_finish(modbus_master_t *m, int error, modbus_request_t **finished)
+{
+    int n = m->active_cnt;
+    for (int i = 0; i < n; ++i) {
+        finished[i] = m->active[i];
+        finished[i]->error = error;
+    }
+    m->stats.requests += n;
+    m->active_cnt = 0;
+    m->state = STATE_IDLE;
+    return n;
+}
+
+/*!
+ * Repeats the transaction of master \a m, or finishes it with \a error if there are no tries left.
+ * \param m Pointer to the master.
+ * \param error Result as modbus_error_t, if the transaction is finished.
+ * \param finished Array of the finished requests.
+ * \return Number of the finished requests.
+ */
+static int transaction_retry(modbus_master_t *m, int error, modbus_request_t **finished)
+{
+    if (!m->tries) {
+        return transaction_finish(m, error, finished);
+    }
+    m->tries--;
+    m->stats.retries++;
+    m->state = STATE_SEND;
+    return 0;
+}
+
+/*!
+ * Checks the frames received by master \a m in the state STATE_WAIT.
+ * \param m Pointer to the master.
+ * \param finished Array of the finished requests.
+ * \return Number of the finished requests.
+ */
+static int response_poll(modbus_master_t *m, modbus_request_t **finished)
+{
+    char buf[MODBUS_ADU_MAX];
+
+    while (sio_rx_frames(m->nport)) {
+        u16 crc;
+        int len = sio_recv_frame_crc(m->nport, buf, sizeof(buf), &crc);
+        if (len <= 0) {
+            if (0 == len) {
+                break;
+            }
+            m->stats.ignored++; // Too long.
+            continue;
+        }
+        if (crc) {
+            m->stats.crc_errors++;
+            continue;
+        }
+        int error = response_check(m, buf, len - FRAME_CRC);
+        if (-1 == error) {
+            continue;
+        }
+        if (MODBUS_ERR_INVALID_RESPONSE == error) {
+            return transaction_retry(m, error, finished);
+        }
+        if ((MODBUS_ERR_NONE == error) && is_read(m->function)) {
+            response_decode(m, buf);
+        }
+        return transaction_finish(m, error, finished);
+    }
+
+    if (tio_expired(&m->deadline)) {
+        m->stats.timeouts++;
+        return transaction_retry(m, MODBUS_ERR_TIMEOUT, finished);
+    }
+    return 0;
+}
+
+
+/*!
+ * Writes the byte \a c of the response to \a w.
+ */
+static void writer_put(modbus_writer_t *w, int c)
+{
+    if (w->pos < w->len1) {
+        w->ptr1[w->pos] = (char)c;
+    } else {
+        w->ptr2[w->pos - w->len1] = (char)c;
+    }
+    w->pos++;
+}
+
+/*!
+ * Writes the word \a v of the response to \a w, the high byte first.
+ */
+static void writer_put16(modbus_writer_t *w, u16 v)
+{
+    writer_put(w, v >> 8);
+    writer_put(w, v & 0xFF);
+}
+
+/*!
+ * Starts the response of slave \a s with \a function and length \a len
+ * (without the CRC) in the output queue.
+ * \param s Pointer to the slave.
+ * \param w Pointer to the writer.
+ * \param function Function of the response.
+ * \param len Length of the response without the CRC.
+ * \return 0 if there is no space for the response in the output queue.
+ */
+static int reply_begin(modbus_slave_t *s, modbus_writer_t *w, int function, int len)
+{
+    if (sio_tx_reserve(s->nport, &w->ptr1, &w->len1, &w->ptr2, &w->len2) < (len + FRAME_CRC)) {
+        s->stats.dropped++;
+        return 0;
+    }
+    w->pos = 0;
+    writer_put(w, s->address);
+    writer_put(w, function);
+    return 1;
+}
+
+/*!
+ * Appends the CRC to the response of slave \a s and sends it.
+ * \param s Pointer to the slave.
+ * \param w Pointer to the writer.
+ */
+static void reply_end(modbus_slave_t *s, modbus_writer_t *w)
+{
+    int n = (w->pos < w->len1) ? (w->pos) : (w->len1);
+    u16 crc = sio_crc16(SIO_CRC16_INIT, w->ptr1, n);
+    crc = sio_crc16(crc, w->ptr2, w->pos - n);
+    writer_put(w, crc & 0xFF);
+    writer_put(w, crc >> 8);
+    sio_tx_commit(s->nport, w->pos);
+}
+
+/*!
+ * Sends the response of slave \a s to the write request \a buf: the request
+ * up to the value or the number of the registers (coils).
+ * \param s Pointer to the slave.
+ * \param buf A pointer to the request.
+ */
+static void reply_echo(modbus_slave_t *s, const char *buf)
+{
+    modbus_writer_t w;
+    if (reply_begin(s, &w, (u8)buf[1], 6)) {
+        writer_put16(&w, get16(buf + 2));
+        writer_put16(&w, get16(buf + 4));
+        reply_end(s, &w);
+    }
+}
+
+/*!
+ * Checks that the coils (discrete inputs) from \a address of number \a count
+ * are in the slots of the bitmap \a slots.
+ * \return Not 0 if all the coils are mapped.
+ */
+static int bits_check(int slots, u16 address, u16 count)
+{
+    u32 last = ((u32)address + count - 1) / MODBUS_SLOT_CHANNELS;
+    for (u32 slot = address / MODBUS_SLOT_CHANNELS; slot <= last; ++slot) {
+        if ((slot >= SLOTS) || (!((1 << slot) & slots))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*!
+ * Writes the coil \a a of slave \a s to the pending values, they are written
+ * to the DO module by coils_apply().
+ * \param s Pointer to the slave.
+ * \param a Address of the coil.
+ * \param v Value of the coil.
+ */
+static void coil_write(modbus_slave_t *s, u16 a, int v)
+{
+    int slot = a / MODBUS_SLOT_CHANNELS;
+    u16 bit = 1 << (a % MODBUS_SLOT_CHANNELS);
+
+    s->coils_val[slot] = (v) ? (s->coils_val[slot] | bit) : (s->coils_val[slot] & ~bit);
+    s->coils_mask[slot] |= bit;
+}
+
+/*!
+ * Writes the pending coils of slave \a s to the DO modules by set_do_bit().
+ * The coils written by the ISR meanwhile remain pending.
+ * \param s Pointer to the slave.
+ */
+static void coils_apply(modbus_slave_t *s)
+{
+    for (int slot = 0; slot < SLOTS; ++slot) {
+        _disable();
+        u16 mask = s->coils_mask[slot];
+        u16 val = s->coils_val[slot];
+        _enable();
+        if (!mask) {
+            continue;
+        }
+        for (int c = 0; c < MODBUS_SLOT_CHANNELS; ++c) {
+            if ((mask >> c) & 1) {
+                set_do_bit(slot, c, (val >> c) & 1);
+            }
+        }
+        // Only the coils which are not changed again are written.
+        _disable();
+        s->coils_mask[slot] &= ~(mask & ~(s->coils_val[slot] ^ val));
+        _enable();
+    }
+}
+
+/*!
+ * Serves the request \a buf of length \a len (without the CRC) by slave \a s.
+ * \param s Pointer to the slave.
+ * \param buf A pointer to the request.
+ * \param len Length of the request without the CRC.
+ */
+static void slave_serve(modbus_slave_t *s, const char *buf, int len)
+{
+    int broadcast = (MODBUS_BROADCAST == (u8)buf[0]);
+    int function = (u8)buf[1];
+    u16 address = (len >= 4) ? (get16(buf + 2)) : (0);
+    u16 count = (len >= 6) ? (get16(buf + 4)) : (0); // Or the value.
+    int ex = 0;
+    modbus_writer_t w;
+    u16 i;
+    int n;
+
+    s->stats.requests++;
+
+    switch (function) {
+    case MODBUS_READ_COILS:
+    case MODBUS_READ_DISCRETE_INPUTS:
+        if (broadcast) {
+            return;
+        }
+        if ((6 != len) || (!count) || (count > MODBUS_READ_BITS_MAX)) {
+            ex = MODBUS_EX_ILLEGAL_DATA_VALUE;
+        } else if (!bits_check((MODBUS_READ_COILS == function) ? (s->do_slots) : (s->di_slots), address, count)) {
+            ex = MODBUS_EX_ILLEGAL_DATA_ADDRESS;
+        } else if (reply_begin(s, &w, function, FRAME_HEADER + 1 + ((count + 7) / 8))) {
+            writer_put(&w, (count + 7) / 8);
+            int slot = -1;
+            int val = 0;
+            int byte = 0;
+            for (i = 0; i < count; ++i) {
+                u16 a = address + i;
+                if ((a / MODBUS_SLOT_CHANNELS) != slot) { // Read each slot once.
+                    slot = a / MODBUS_SLOT_CHANNELS;
+                    if (MODBUS_READ_COILS == function) {
+                        get_do_val(slot, &val);
+                        // The coils written but not applied yet.
+                        val = (val & ~s->coils_mask[slot]) | (s->coils_val[slot] & s->coils_mask[slot]);
+                    } else {
+                        get_di_val(slot, &val);
+                    }
+                }
+                if ((val >> (a % MODBUS_SLOT_CHANNELS)) & 1) {
+                    byte |= 1 << (i & 7);
+                }
+                if ((7 == (i & 7)) || ((count - 1) == i)) {
+                    writer_put(&w, byte);
+                    byte = 0;
+                }
+            }
+            reply_end(s, &w);
+        }
+        break;
+    case MODBUS_READ_HOLDING_REGISTERS:
+        if (broadcast) {
+            return;
+        }
+        if ((6 != len) || (!count) || (count > MODBUS_READ_REGS_MAX)) {
+            ex = MODBUS_EX_ILLEGAL_DATA_VALUE;
+        } else if (((u32)address + count) > s->regs_cnt) {
+            ex = MODBUS_EX_ILLEGAL_DATA_ADDRESS;
+        } else if (reply_begin(s, &w, function, FRAME_HEADER + 1 + (count * 2))) {
+            writer_put(&w, count * 2);
+            for (i = 0; i < count; ++i) {
+                writer_put16(&w, s->regs[address + i]);
+            }
+            reply_end(s, &w);
+        }
+        break;
+    case MODBUS_WRITE_SINGLE_COIL:
+        if ((6 != len) || ((0xFF00 != count) && (0x0000 != count))) {
+            ex = MODBUS_EX_ILLEGAL_DATA_VALUE;
+        } else if (!bits_check(s->do_slots, address, 1)) {
+            ex = MODBUS_EX_ILLEGAL_DATA_ADDRESS;
+        } else {
+            coil_write(s, address, (0xFF00 == count));
+            if (!broadcast) {
+                reply_echo(s, buf);
+            }
+        }
+        break;
+    case MODBUS_WRITE_SINGLE_REGISTER:
+        if (6 != len) {
+            ex = MODBUS_EX_ILLEGAL_DATA_VALUE;
+        } else if (address >= s->regs_cnt) {
+            ex = MODBUS_EX_ILLEGAL_DATA_ADDRESS;
+        } else {
+            s->regs[address] = count;
+            if (!broadcast) {
+                reply_echo(s, buf);
+            }
+        }
+        break;
+    case MODBUS_WRITE_MULTIPLE_COILS:
+        n = (count + 7) / 8;
+        if ((len < 7) || (!count) || (count > MODBUS_WRITE_BITS_MAX) || (n != (u8)buf[6]) || ((7 + n) != len)) {
+            ex = MODBUS_EX_ILLEGAL_DATA_VALUE;
+        } else if (!bits_check(s->do_slots, address, count)) {
+            ex = MODBUS_EX_ILLEGAL_DATA_ADDRESS;
+        } else {
+            for (i = 0; i < count; ++i) {
+                coil_write(s, address + i, (buf[7 + (i >> 3)] >> (i & 7)) & 1);
+            }
+            if (!broadcast) {
+                reply_echo(s, buf);
+            }
+        }
+        break;
+    case MODBUS_WRITE_MULTIPLE_REGISTERS:
+        n = count * 2;
+        if ((len < 7) || (!count) || (count > MODBUS_WRITE_REGS_MAX) || (n != (u8)buf[6]) || ((7 + n) != len)) {
+            ex = MODBUS_EX_ILLEGAL_DATA_VALUE;
+        } else if (((u32)address + count) > s->regs_cnt) {
+            ex = MODBUS_EX_ILLEGAL_DATA_ADDRESS;
+        } else {
+            for (i = 0; i < count; ++i) {
+                s->regs[address + i] = get16(buf + 7 + (i * 2));
+            }
+            if (!broadcast) {
+                reply_echo(s, buf);
+            }
+        }
+        break;
+    default:
+        ex = MODBUS_EX_ILLEGAL_FUNCTION;
+        break;
+    }
+
+    if (ex) {
+        s->stats.exceptions++;
+        if ((!broadcast) && reply_begin(s, &w, function | 0x80, FRAME_HEADER + 1)) {
+            writer_put(&w, ex);
+            reply_end(s, &w);
+        }
+    }
+}
+
+/*!
+ * Serves the received requests of slave \a s.
+ * \param s Pointer to the slave.
+ * \return Number of the served requests.
+ */
+static int slave_frames(modbus_slave_t *s)
+{
+    int served = 0;
+
+    while (sio_rx_frames(s->nport)) {
+        u16 crc;
+        int len = sio_recv_frame_crc(s->nport, s->adu, sizeof(s->adu), &crc);
+        if (len <= 0) {
+            if (0 == len) {
+                break;
+            }
+            s->stats.ignored++; // Too long.
+            continue;
+        }
+        if (crc) {
+            s->stats.crc_errors++;
+            continue;
+        }
+        len -= FRAME_CRC;
+        if ((len < FRAME_HEADER) || ((s->address != (u8)s->adu[0]) && (MODBUS_BROADCAST != (u8)s->adu[0]))) {
+            s->stats.ignored++;
+            continue;
+        }
+        slave_serve(s, s->adu, len);
+        ++served;
+    }
+    return served;
+}
+
+/*!
+ * RX notification of the port of a slave, it is called from the ISR:
+ * serves the requests when the frame is closed.
+ * \param nport Port number as sio_com_t.
+ * \param events Events as sio_event_t.
+ */
+static void slave_notify(sio_com_t nport, int events)
+{
+    modbus_slave_t *s = port_slaves[nport];
+
+    // modbus_slave_poll() takes the frames now, it serves this one too.
+    if ((!(SIO_EV_FRAME & events)) || (!s) || s->busy) {
+        return;
+    }
+    s->busy = 1;
+    slave_frames(s);
+    s->busy = 0;
+}
+
+//--------------------------------------------------------------------------------------------------------//
+/*** Public functions ***/
+
+/*!
+ * Initializes master \a m on port \a nport.
+ * \note The port must be opened (in the non-blocking mode, else the sending waits for
+ * the space in the output queue) and configured before, and it is used only by the master.
+ * The function enables the framing mode of the port with the CRC by the ISR.
+ * \param m Pointer to the master.
+ * \param nport Port number as sio_com_t.
+ * \return -1 on error.
+ */
+int modbus_master_init(modbus_master_t *m, sio_com_t nport)
+{
+    memset(m, 0, sizeof(modbus_master_t));
+    m->nport = nport;
+    m->timeout_ms = MODBUS_TIMEOUT_MS;
+    m->retries = MODBUS_RETRIES;
+
+    if ((-1 == sio_set_rx_framing(nport, SIO_FRAME_T35)) || (-1 == sio_set_rx_crc(nport, 1))) {
+        modbuserrno = MODBUS_ERR_PORT;
+        return -1;
+    }
+
+    modbuserrno = MODBUS_ERR_NONE;
+    return 0;
+}
+
+/*!
+ * Sets the timeout of the response and the number of the retries of \a slave of master \a m.
+ * \param m Pointer to the master.
+ * \param slave Address of the slave, or MODBUS_BROADCAST to set the default
+ * of the slaves without own settings.
+ * \param timeout_ms Timeout of the response, in ms (without the transfer time of the request).
+ * \param retries Number of the retries after a timeout or an invalid response, 0 - 255.
+ * \return -1 on error (MODBUS_ERR_ILLEGAL_SETTING if the table of the slaves is full).
+ */
+int modbus_master_set_timeout(modbus_master_t *m, u8 slave, u16 timeout_ms, int retries)
+{
+    if ((slave > 247) || (retries < 0) || (retries > 255)) {
+        modbuserrno = MODBUS_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
+
+    if (MODBUS_BROADCAST == slave) {
+        m->timeout_ms = timeout_ms;
+        m->retries = retries;
+    } else {
+        int i = slave_find(m, slave);
+        if (-1 == i) {
+            if (MODBUS_SLAVES_MAX == m->slaves_cnt) {
+                modbuserrno = MODBUS_ERR_ILLEGAL_SETTING;
+                return -1;
+            }
+            i = m->slaves_cnt++;
+            m->slaves[i].slave = slave;
+        }
+        m->slaves[i].timeout_ms = timeout_ms;
+        m->slaves[i].retries = (u8)retries;
+    }
+
+    modbuserrno = MODBUS_ERR_NONE;
+    return 0;
+}
+
+/*!
+ * Queues request \a req to master \a m. The request is sent by modbus_master_poll(),
+ * its field \a error is MODBUS_ERR_PENDING until it is finished.
+ * \param m Pointer to the master.
+ * \param req Pointer to the request.
+ * \return -1 on error.
+ */
+int modbus_master_submit(modbus_master_t *m, modbus_request_t *req)
+{
+    if (!request_check(req)) {
+        modbuserrno = MODBUS_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
+
+    if (MODBUS_QUEUE == m->queued) {
+        modbuserrno = MODBUS_ERR_QUEUE_FULL;
+        return -1;
+    }
+
+    req->error = MODBUS_ERR_PENDING;
+    req->exception = 0;
+    m->queue[m->queued++] = req;
+
+    modbuserrno = MODBUS_ERR_NONE;
+    return 0;
+}
+
+/*!
+ * Advances the transactions of master \a m: accepts the response, repeats
+ * the request on the timeout, sends the next request, and calls the completion
+ * callbacks of the finished requests. It never waits.
+ * \note Call it more often than the wrap of tio_now() (65 ms), and more
+ * often than the timeout of the response.
+ * \param m Pointer to the master.
+ * \return Number of the requests queued and in progress.
+ */
+int modbus_master_poll(modbus_master_t *m)
+{
+    // The previous transaction and the next one, if its sending fails.
+    modbus_request_t *finished[MODBUS_COALESCE_MAX * 2];
+    int finished_cnt = 0;
+
+    if (STATE_WAIT == m->state) {
+        finished_cnt = response_poll(m, finished);
+    } else if ((STATE_BROADCAST == m->state) && tio_expired(&m->deadline)) {
+        finished_cnt = transaction_finish(m, MODBUS_ERR_NONE, finished);
+    }
+
+    if ((STATE_IDLE == m->state) && m->queued) {
+        queue_take(m);
+        request_encode(m);
+        m->state = STATE_SEND;
+    }
+
+    if ((STATE_SEND == m->state) && (-1 == request_send(m))) {
+        // The callbacks of the previous transaction are called together with these.
+        int n = m->active_cnt;
+        transaction_finish(m, MODBUS_ERR_PORT, finished + finished_cnt);
+        finished_cnt += n;
+    }
+
+    // The next request is on the line already.
+    for (int i = 0; i < finished_cnt; ++i) {
+        if (finished[i]->done) {
+            finished[i]->done(finished[i]);
+        }
+    }
+
+    return m->queued + m->active_cnt;
+}
+
+/*!
+ * Reads the statistics of master \a m.
+ * \param m Pointer to the master.
+ * \param stats Pointer to the structure to which the statistics is copied.
+ * \return -1 on error.
+ */
+int modbus_master_get_stats(modbus_master_t *m, modbus_master_stats_t *stats)
+{
+    memcpy(stats, &m->stats, sizeof(modbus_master_stats_t));
+    modbuserrno = MODBUS_ERR_NONE;
+    return 0;
+}
+
+/*!
+ * Closes master \a m: the requests queued and in progress are finished
+ * with MODBUS_ERR_CANCELLED, and the framing mode of the port is disabled.
+ * \param m Pointer to the master.
+ */
+void modbus_master_close(modbus_master_t *m)
+{
+    modbus_request_t *finished[MODBUS_COALESCE_MAX];
+    int n = transaction_finish(m, MODBUS_ERR_CANCELLED, finished);
+    for (int i = 0; i < n; ++i) {
+        if (finished[i]->done) {
+            finished[i]->done(finished[i]);
+        }
+    }
+    for (int i = 0; i < m->queued; ++i) {
+        m->queue[i]->error = MODBUS_ERR_CANCELLED;
+        if (m->queue[i]->done) {
+            m->queue[i]->done(m->queue[i]);
+        }
+    }
+    m->queued = 0;
+
+    sio_set_rx_crc(m->nport, 0);
+    sio_set_rx_framing(m->nport, 0);
+}
+
+/*!
+ * Initializes slave \a s with \a address on port \a nport. The slave serves
+ * no coils, inputs and registers until modbus_slave_set_slots() and
+ * modbus_slave_set_registers() are called.
+ * \note The port must be opened and configured before, and it is used only by the slave.
+ * The function enables the framing mode of the port with the CRC by the ISR,
+ * and sets the RX notification of the port (sio_set_rx_notify()), by which
+ * the ISR serves the requests.
+ * The output queue must hold the longest response (MODBUS_ADU_MAX).
+ * \param s Pointer to the slave.
+ * \param nport Port number as sio_com_t.
+ * \param address Address of the slave, 1 - 247.
+ * \return -1 on error.
+ */
+int modbus_slave_init(modbus_slave_t *s, sio_com_t nport, u8 address)
+{
+    if ((MODBUS_BROADCAST == address) || (address > 247)) {
+        modbuserrno = MODBUS_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
+
+    memset(s, 0, sizeof(modbus_slave_t));
+    s->nport = nport;
+    s->address = address;
+
+    if ((-1 == sio_set_rx_framing(nport, SIO_FRAME_T35)) || (-1 == sio_set_rx_crc(nport, 1))) {
+        modbuserrno = MODBUS_ERR_PORT;
+        return -1;
+    }
+
+    port_slaves[nport] = s;
+    if (-1 == sio_set_rx_notify(nport, 0, SIO_NO_DELIMITER, slave_notify)) {
+        port_slaves[nport] = 0;
+        modbuserrno = MODBUS_ERR_PORT;
+        return -1;
+    }
+
+    modbuserrno = MODBUS_ERR_NONE;
+    return 0;
+}
+
+/*!
+ * Maps the local I/O modules to slave \a s: the discrete inputs (function 2)
+ * are read from the DI modules of the slots \a di_slots by get_di_val(), the coils
+ * (functions 1, 5, 15) are the channels of the DO modules of the slots \a do_slots
+ * (get_do_val(), set_do_bit()). The addresses are given by MODBUS_SLOT_CHANNELS.
+ * \param s Pointer to the slave.
+ * \param di_slots Bitmap of the slots with the DI modules, the bit 0 is the slot 0.
+ * \param do_slots Bitmap of the slots with the DO modules.
+ * \return -1 on error.
+ */
+int modbus_slave_set_slots(modbus_slave_t *s, int di_slots, int do_slots)
+{
+    if ((di_slots & ~((1 << SLOTS) - 1)) || (do_slots & ~((1 << SLOTS) - 1))) {
+        modbuserrno = MODBUS_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
+
+    s->di_slots = di_slots;
+    s->do_slots = do_slots;
+
+    modbuserrno = MODBUS_ERR_NONE;
+    return 0;
+}
+
+/*!
+ * Sets the table of the holding registers of slave \a s (functions 3, 6, 16).
+ * The table belongs to the caller, and it is read and written by the ISR of the port
+ * (disable the interrupts to access several registers as a whole).
+ * \param s Pointer to the slave.
+ * \param regs Pointer to the table, or 0.
+ * \param cnt Number of the registers.
+ * \return -1 on error.
+ */
+int modbus_slave_set_registers(modbus_slave_t *s, u16 *regs, u16 cnt)
+{
+    s->regs = regs;
+    s->regs_cnt = (regs) ? (cnt) : (0);
+
+    modbuserrno = MODBUS_ERR_NONE;
+    return 0;
+}
+
+/*!
+ * Writes the coils written by the master to the DO modules of slave \a s (set_do_bit()),
+ * and serves the requests which the ISR has not served (the frames closed
+ * by sio_rx_frames(), e.g. of the port COM_PGM or without FIFO). It never waits.
+ * \note The requests are served by the ISR, the scan time of the main loop
+ * delays only the writes of the coils to the DO modules.
+ * \param s Pointer to the slave.
+ * \return Number of the requests served by this call.
+ */
+int modbus_slave_poll(modbus_slave_t *s)
+{
+    // The ISR does not serve the frames meanwhile.
+    s->busy = 1;
+    int served = slave_frames(s);
+    s->busy = 0;
+
+    coils_apply(s);
+    return served;
+}
+
+/*!
+ * Reads the statistics of slave \a s.
+ * \param s Pointer to the slave.
+ * \param stats Pointer to the structure to which the statistics is copied.
+ * \return -1 on error.
+ */
+int modbus_slave_get_stats(modbus_slave_t *s, modbus_slave_stats_t *stats)
+{
+    memcpy(stats, &s->stats, sizeof(modbus_slave_stats_t));
+    modbuserrno = MODBUS_ERR_NONE;
+    return 0;
+}
+
+/*!
+ * Closes slave \a s: the pending coils are written, the RX notification
+ * and the framing mode of the port are disabled.
+ * \param s Pointer to the slave.
+ */
+void modbus_slave_close(modbus_slave_t *s)
+{
+    sio_set_rx_notify(s->nport, 0, SIO_NO_DELIMITER, 0);
+    port_slaves[s->nport] = 0;
+    coils_apply(s);
+
+    sio_set_rx_crc(s->nport, 0);
+    sio_set_rx_framing(s->nport, 0);
+}
@@ -0,0 +1,264 @@
+/*********************************************************************************************
+Project :
+Version :
+Date    : 17.10.2026
+Author  :
+Company :
+Comments: A library for work with the Modbus RTU protocol in your controllers ADAM 5000 series.
+License : New BSD
+**********************************************************************************************/
+
+/*! \file modbus.h
+ *
+ * This is the header file for the module implementation "modbus.cpp".
+ * This header file is declared interface of the Modbus RTU master and slave
+ * over the serial ports of the module "sio", and declared the corresponding data types.
+ */
+
+#ifndef MODBUS_H
+#define MODBUS_H
+
+#include "platformdefs.h"
+#include "../sio/sio.h"
+#include "../tio/tio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Size of the request queue of the master.
+ */
+#define MODBUS_QUEUE 16
+
+/*!
+ * Number of the slaves, which can have own timeout and retries.
+ */
+#define MODBUS_SLAVES_MAX 64
+
+/*!
+ * Maximum number of the requests coalesced into one transaction.
+ */
+#define MODBUS_COALESCE_MAX 8
+
+/*!
+ * Maximum size of the frame (ADU) with the address and the CRC, in bytes.
+ */
+#define MODBUS_ADU_MAX 256
+
+/*!
+ * Maximum number of the registers of one read transaction.
+ */
+#define MODBUS_READ_REGS_MAX 125
+
+/*!
+ * Maximum number of the coils (inputs) of one read transaction.
+ */
+#define MODBUS_READ_BITS_MAX 2000
+
+/*!
+ * Maximum number of the registers of one write transaction.
+ */
+#define MODBUS_WRITE_REGS_MAX 123
+
+/*!
+ * Maximum number of the coils of one write transaction.
+ */
+#define MODBUS_WRITE_BITS_MAX 1968
+
+/*!
+ * Address of the broadcast request (only the write functions, without the response).
+ */
+#define MODBUS_BROADCAST 0
+
+/*!
+ * Default timeout of the response, in ms.
+ */
+#define MODBUS_TIMEOUT_MS 100
+
+/*!
+ * Default number of the retries after a timeout or an invalid response.
+ */
+#define MODBUS_RETRIES 2
+
+/*!
+ * Delay after a broadcast request, in ms, while the slaves process it.
+ */
+#define MODBUS_BROADCAST_MS 100
+
+/*!
+ * Number of the coils (discrete inputs) of the slave per slot of the I/O modules:
+ * the channel \a c of the module in the slot \a s has the address s * 16 + c.
+ */
+#define MODBUS_SLOT_CHANNELS 16
+
+/*!
+ * Number of the slots of the I/O modules.
+ */
+#define MODBUS_SLOTS 8
+
+/*!
+ * Supported functions.
+ */
+typedef enum MODBUS_FUNCTION {
+    MODBUS_READ_COILS               = 0x01, /*!< Read Coils. */
+    MODBUS_READ_DISCRETE_INPUTS     = 0x02, /*!< Read Discrete Inputs. */
+    MODBUS_READ_HOLDING_REGISTERS   = 0x03, /*!< Read Holding Registers. */
+    MODBUS_READ_INPUT_REGISTERS     = 0x04, /*!< Read Input Registers. */
+    MODBUS_WRITE_SINGLE_COIL        = 0x05, /*!< Write Single Coil. */
+    MODBUS_WRITE_SINGLE_REGISTER    = 0x06, /*!< Write Single Register. */
+    MODBUS_WRITE_MULTIPLE_COILS     = 0x0F, /*!< Write Multiple Coils. */
+    MODBUS_WRITE_MULTIPLE_REGISTERS = 0x10  /*!< Write Multiple Registers. */
+} modbus_function_t;
+
+/*!
+ * Error codes of the functions and of the requests.
+ */
+typedef enum MODBUS_ERROR {
+    MODBUS_ERR_NONE             = 0, /*!< No errors. */
+    MODBUS_ERR_ILLEGAL_SETTING  = 1, /*!< Incorrect parameters. */
+    MODBUS_ERR_QUEUE_FULL       = 2, /*!< The request queue is full. */
+    MODBUS_ERR_PENDING          = 3, /*!< The request is queued or in progress. */
+    MODBUS_ERR_TIMEOUT          = 4, /*!< No response after all retries. */
+    MODBUS_ERR_INVALID_RESPONSE = 5, /*!< Invalid response after all retries. */
+    MODBUS_ERR_EXCEPTION        = 6, /*!< The slave returned an exception. */
+    MODBUS_ERR_PORT             = 7, /*!< Error of the serial port, see sioerrno. */
+    MODBUS_ERR_CANCELLED        = 8  /*!< The request is cancelled by modbus_master_close(). */
+} modbus_error_t;
+
+/*!
+ * Exception codes of the slave.
+ */
+typedef enum MODBUS_EXCEPTION {
+    MODBUS_EX_ILLEGAL_FUNCTION     = 0x01, /*!< The function is not supported. */
+    MODBUS_EX_ILLEGAL_DATA_ADDRESS = 0x02, /*!< The addresses are out of the map. */
+    MODBUS_EX_ILLEGAL_DATA_VALUE   = 0x03  /*!< Invalid number or value, or invalid length of the request. */
+} modbus_exception_t;
+
+typedef struct MODBUS_REQUEST modbus_request_t;
+
+/*!
+ * Completion callback of a request, it is called from modbus_master_poll().
+ * \param req Pointer to the finished request.
+ */
+typedef void (*modbus_done_t)(modbus_request_t *req);
+
+/*!
+ * Request of the master. The structure belongs to the caller and must remain
+ * valid until the request is finished (\a error is not MODBUS_ERR_PENDING).
+ */
+struct MODBUS_REQUEST {
+    u8 slave;               /*!< Address of the slave 1 - 247, or MODBUS_BROADCAST. */
+    u8 function;            /*!< Function as modbus_function_t. */
+    u16 address;            /*!< Address of the first register or coil. */
+    u16 count;              /*!< Number of the registers or coils. */
+    u16 *regs;              /*!< Registers: the result of a read or the values to write. */
+    u8 *bits;               /*!< Coils and inputs, 8 per byte from the bit 0: the result of a read or the values to write. */
+    modbus_done_t done;     /*!< Completion callback, or 0. */
+    void *context;          /*!< Pointer of the caller, not used by the master. */
+    volatile int error;     /*!< Result as modbus_error_t. */
+    u8 exception;           /*!< Exception code of the slave with MODBUS_ERR_EXCEPTION. */
+};
+
+/*!
+ * Timeout and retries of one slave of the master.
+ */
+typedef struct MODBUS_SLAVE_CFG {
+    u8 slave;        /*!< Address of the slave. */
+    u8 retries;      /*!< Number of the retries. */
+    u16 timeout_ms;  /*!< Timeout of the response, in ms. */
+} modbus_slave_cfg_t;
+
+/*!
+ * Statistics of the master.
+ */
+typedef struct MODBUS_MASTER_STATS {
+    u32 requests;      /*!< Number of the finished requests. */
+    u32 transactions;  /*!< Number of the frames sent (with the retries). */
+    u32 coalesced;     /*!< Number of the requests merged into a transaction of another request. */
+    u32 retries;       /*!< Number of the retries. */
+    u32 timeouts;      /*!< Number of the timeouts of the response. */
+    u32 crc_errors;    /*!< Number of the received frames with the invalid CRC. */
+    u32 ignored;       /*!< Number of the received frames of other slaves or too short. */
+    u32 exceptions;    /*!< Number of the exception responses. */
+} modbus_master_stats_t;
+
+/*!
+ * Master on one serial port. The fields are private, the structure
+ * is declared here only to be allocated by the caller.
+ */
+typedef struct MODBUS_MASTER {
+    sio_com_t nport;       /*!< Port number. */
+    int state;             /*!< State of the transaction. */
+    u16 timeout_ms;        /*!< Default timeout, in ms. */
+    int retries;           /*!< Default number of the retries. */
+    modbus_slave_cfg_t slaves[MODBUS_SLAVES_MAX]; /*!< Own timeouts and retries of the slaves. */
+    int slaves_cnt;        /*!< Number of the entries of \a slaves. */
+    modbus_request_t *queue[MODBUS_QUEUE];        /*!< Queued requests, in the order of the submission. */
+    int queued;            /*!< Number of the queued requests. */
+    modbus_request_t *active[MODBUS_COALESCE_MAX]; /*!< Requests of the current transaction. */
+    int active_cnt;        /*!< Number of the requests of the current transaction. */
+    u8 slave;              /*!< Transaction: address of the slave. */
+    u8 function;           /*!< Transaction: function. */
+    u16 address;           /*!< Transaction: address of the first register or coil. */
+    u16 count;             /*!< Transaction: number of the registers or coils. */
+    int tries;             /*!< Transaction: number of the retries left. */
+    u16 tx_ms;             /*!< Transaction: transfer time of the request, in ms. */
+    u16 wait_ms;           /*!< Transaction: timeout of the response, in ms. */
+    tio_deadline_t deadline; /*!< Transaction: deadline of the response. */
+    int len;               /*!< Transaction: length of the request without the CRC. */
+    char adu[MODBUS_ADU_MAX]; /*!< Transaction: the request without the CRC. */
+    modbus_master_stats_t stats; /*!< Statistics. */
+} modbus_master_t;
+
+/*!
+ * Statistics of the slave.
+ */
+typedef struct MODBUS_SLAVE_STATS {
+    u32 requests;      /*!< Number of the served requests (with the broadcast ones). */
+    u32 exceptions;    /*!< Number of the exception responses. */
+    u32 crc_errors;    /*!< Number of the received frames with the invalid CRC. */
+    u32 ignored;       /*!< Number of the received frames of other slaves or too short. */
+    u32 dropped;       /*!< Number of the responses not sent, there was no space in the output queue. */
+} modbus_slave_stats_t;
+
+/*!
+ * Slave on one serial port. The fields are private, the structure
+ * is declared here only to be allocated by the caller.
+ */
+typedef struct MODBUS_SLAVE {
+    sio_com_t nport;   /*!< Port number. */
+    u8 address;        /*!< Address of the slave. */
+    int di_slots;      /*!< Bitmap of the slots with the DI modules (the discrete inputs), the bit 0 is the slot 0. */
+    int do_slots;      /*!< Bitmap of the slots with the DO modules (the coils), the bit 0 is the slot 0. */
+    u16 *regs;         /*!< Table of the holding registers of the caller, or 0. */
+    u16 regs_cnt;      /*!< Number of the holding registers. */
+    volatile u16 coils_val[MODBUS_SLOTS];  /*!< Values of the coils written by the ISR, set_do_bit() is called by modbus_slave_poll(). */
+    volatile u16 coils_mask[MODBUS_SLOTS]; /*!< Bitmap of the coils in \a coils_val not written to the DO modules yet. */
+    volatile int busy; /*!< Not 0 while the requests are served (by the ISR or by modbus_slave_poll()). */
+    char adu[MODBUS_ADU_MAX]; /*!< Received request. */
+    modbus_slave_stats_t stats; /*!< Statistics. */
+} modbus_slave_t;
+
+/*!
+ * This variable contains the error code of the last function call.
+ */
+extern int modbuserrno;
+
+int modbus_master_init(modbus_master_t *m, sio_com_t nport);
+int modbus_master_set_timeout(modbus_master_t *m, u8 slave, u16 timeout_ms, int retries);
+int modbus_master_submit(modbus_master_t *m, modbus_request_t *req);
+int modbus_master_poll(modbus_master_t *m);
+int modbus_master_get_stats(modbus_master_t *m, modbus_master_stats_t *stats);
+void modbus_master_close(modbus_master_t *m);
+int modbus_slave_init(modbus_slave_t *s, sio_com_t nport, u8 address);
+int modbus_slave_set_slots(modbus_slave_t *s, int di_slots, int do_slots);
+int modbus_slave_set_registers(modbus_slave_t *s, u16 *regs, u16 cnt);
+int modbus_slave_poll(modbus_slave_t *s);
+int modbus_slave_get_stats(modbus_slave_t *s, modbus_slave_stats_t *stats);
+void modbus_slave_close(modbus_slave_t *s);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // MODBUS_H
@@ -0,0 +1,79 @@
+/*********************************************************************************************
+Project :
+Version :
+Date    : 17.10.2026
+Author  :
+Company :
+Comments: A library for work with the port I/O in your controllers ADAM 5000 series.
+License : New BSD
+**********************************************************************************************/
+
+/*! \file pio.h
+ *
+ * Abbreviation of the module (file) "pio" - Port Input Output.
+ *
+ * This header file is the port I/O layer of the modules "io": the functions
+ * inp(), inpw(), outp(), outpw(), the interrupt vectors _dos_getvect(),
+ * _dos_setvect() and the control of interrupts _enable(), _disable().
+ *
+ * With Watcom (the target PLC ADAM 5510) they are taken from <conio.h>
+ * and <dos.h> without any overhead. On the host (Linux) they are implemented
+ * by a backend linked with the program, e.g. the simulator "piosim.cpp"
+ * of the UARTs 16550, the internal UART of the CPU Am188ES and the interrupt
+ * controller, which is used by the tests and the benchmarks.
+ */
+
+#ifndef PIO_H
+#define PIO_H
+
+#include "platformdefs.h"
+
+#if defined (__WATCOMC__)
+
+#include <dos.h>
+#include <conio.h>
+
+#else // Host builds of the tests and benchmarks.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define __interrupt
+#define __far
+#define _fmemcpy memcpy
+
+#define _enable()
+#define _disable()
+
+/*!
+ * Interrupt handler.
+ */
+typedef void (*pio_vect_t)(void);
+
+unsigned int inp(int port);
+unsigned int inpw(int port);
+unsigned int outp(int port, int value);
+unsigned int outpw(int port, unsigned int value);
+pio_vect_t _dos_getvect(int intnum);
+void _dos_setvect(int intnum, pio_vect_t handler);
+
+/*!
+ * Counters of the port accesses of the backend.
+ */
+typedef struct PIO_STATS {
+    u32 reads;  /*!< Number of the reads (inp(), inpw() is counted as two). */
+    u32 writes; /*!< Number of the writes (outp(), outpw() is counted as two). */
+    u32 clocks; /*!< Number of the CPU clocks spent on the port accesses. */
+} pio_stats_t;
+
+void pio_get_stats(pio_stats_t *stats);
+void pio_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __WATCOMC__
+
+#endif // PIO_H
@@ -0,0 +1,541 @@
+/*********************************************************************************************
+Project :
+Version :
+Date    : 17.10.2026
+Author  :
+Company :
+Comments: A library for work with the port I/O in your controllers ADAM 5000 series.
+License : New BSD
+**********************************************************************************************/
+
+/*! \file piosim.cpp
+ *
+ * This module implements the host (Linux) backend of "pio.h": the simulator of
+ * the port I/O of the PLC ADAM 5510, for the tests and the benchmarks of the
+ * modules "io" outside the controller.
+ *
+ * Simulated are the registers of the UARTs 16550 of COM1, COM2 and COM4 used by
+ * the module "sio" (the UARTs have the 16 byte FIFOs and have not the automatic
+ * flow control), the internal UART of the CPU at 0xFF80 - 0xFF88, the timer 1
+ * at 0xFF58 as the microsecond counter of the module "tio", and the interrupt
+ * controller: EOI at 0xFF22 and the mask at 0xFF28. Other registers of the
+ * peripheral control block (0xFF00 - 0xFFFF) just keep the written values.
+ *
+ * Each port access is counted and costs PIOSIM_IO_CLOCKS of the CPU clocks, the
+ * simulated time runs by these clocks and by piosim_advance(). The RX interrupts
+ * of the UARTs 16550 follow the programmed RX FIFO trigger level: the Received
+ * Data Available is raised when the FIFO holds the trigger level bytes, the
+ * Character Timeout when the FIFO holds fewer bytes and for 4 character times
+ * (by the divisor and LCR) no byte was received nor read. The interrupts are
+ * not generated by themselves, the program checks them by piosim_pending() and
+ * calls the installed handler by piosim_interrupt().
+ */
+
+#include "piosim.h"
+
+#include <string.h>
+
+
+//--------------------------------------------------------------------------------------------------------//
+/*** Private types ***/
+
+/*!
+ * Simulated UART 16550.
+ */
+typedef struct SIM_UART {
+    u8 ier;                /*!< IER. */
+    u8 lcr;                /*!< LCR. */
+    u8 mcr;                /*!< MCR. */
+    u8 scr;                /*!< SCR. */
+    u8 fcr;                /*!< FCR, without the clear bits. */
+    u8 dll;                /*!< Divisor Latch, low byte. */
+    u8 dlm;                /*!< Divisor Latch, high byte. */
+    u8 rx[PIOSIM_FIFO];    /*!< RX FIFO. */
+    int rx_head;           /*!< Index of the first byte of the RX FIFO. */
+    int rx_count;          /*!< Number of bytes in the RX FIFO. */
+    u32 rx_time;           /*!< Simulated time of the last byte received or read from the RX FIFO. */
+    int thre_pending;      /*!< Not 0 if the THRE interrupt is pending. */
+    u32 tx_count;          /*!< Number of the transmitted bytes. */
+} sim_uart_t;
+
+/*!
+ * Simulated internal UART of the CPU (COM_PGM).
+ */
+typedef struct SIM_PGM {
+    u16 con;               /*!< Control Register. */
+    u16 brd;               /*!< Baud Rate Divisor Register. */
+    u16 rx;                /*!< Receive Register. */
+    int rx_full;           /*!< Not 0 if the Receive Register holds a byte. */
+    u32 tx_count;          /*!< Number of the transmitted bytes. */
+} sim_pgm_t;
+
+//--------------------------------------------------------------------------------------------------------//
+/*** Private variables ***/
+
+/*!
+ * Base addresses of the simulated UARTs 16550.
+ */
+static const int bases[3] = {PIOSIM_COM1, PIOSIM_COM2, PIOSIM_COM4};
+/*!
+ * Simulated UARTs 16550.
+ */
+static sim_uart_t uarts[3];
+/*!
+ * Simulated internal UART of the CPU.
+ */
+static sim_pgm_t pgm;
+/*!
+ * Peripheral control block 0xFF00 - 0xFFFF, by words.
+ */
+static u16 pcb[128];
+/*!
+ * Interrupt vectors.
+ */
+static pio_vect_t vects[256];
+/*!
+ * Counters of the port accesses.
+ */
+static pio_stats_t counters;
+/*!
+ * Simulated time, in the CPU clocks.
+ */
+static u32 now_clocks = 0;
+/*!
+ * Number of EOI written to the interrupt controller.
+ */
+static u32 eois = 0;
+
+//--------------------------------------------------------------------------------------------------------//
+/*** Private functions ***/
+
+/*!
+ * Returns the simulated UART 16550, which owns \a port, or 0.
+ * \param port Port address.
+ * \param off Pointer to which the offset of the register is written.
+ */
+static sim_uart_t *uart_find(int port, int *off)
+{
+    for (int i = 0; i < 3; ++i) {
+        if ((port >= bases[i]) && (port <= (bases[i] + 7))) {
+            *off = port - bases[i];
+            return &uarts[i];
+        }
+    }
+    return 0;
+}
+
+/*!
+ * Returns the RX FIFO trigger level of UART \a u, in bytes.
+ * \param u Pointer to the simulated UART.
+ */
+static int uart_trigger(const sim_uart_t *u)
+{
+    static const int levels[4] = {1, 4, 8, 14};
+    return (u->fcr & 0x01) ? levels[u->fcr >> 6] : 1;
+}
+
+/*!
+ * Returns the time of the Character Timeout of UART \a u (4 characters
+ * by the divisor and LCR), in the CPU clocks. The divisor 0 is taken as 1.
+ * \param u Pointer to the simulated UART.
+ */
+static u32 uart_timeout(const sim_uart_t *u)
+{
+    unsigned long long div = (u->dlm << 8) | u->dll;
+    unsigned long long bits = 1 + 5 + (u->lcr & 0x03) + ((u->lcr & 0x08) ? 1 : 0) + ((u->lcr & 0x04) ? 2 : 1);
+    if (!div) {
+        div = 1;
+    }
+    // Divisor 1 is 115200 bps (1.8432 MHz / 16).
+    return (u32)(4 * bits * div * PIOSIM_CPU_CLOCK / 115200UL);
+}
+
+/*!
+ * Returns the identification of the pending interrupt of UART \a u as
+ * the bits 1 - 3 of IIR, or 0x01 if there is no pending interrupt.
+ * \param u Pointer to the simulated UART.
+ */
+static int uart_iir(const sim_uart_t *u)
+{
+    if ((u->ier & 0x01) && (u->rx_count >= uart_trigger(u))) {
+        return 0x04; // Received Data Available.
+    }
+    if ((u->ier & 0x01) && u->rx_count && ((now_clocks - u->rx_time) >= uart_timeout(u))) {
+        return 0x0C; // Character Timeout.
+    }
+    if ((u->ier & 0x02) && u->thre_pending) {
+        return 0x02;
+    }
+    return 0x01;
+}
+
+/*!
+ * Returns the value of LSR of UART \a u.
+ * \param u Pointer to the simulated UART.
+ */
+static int uart_lsr(const sim_uart_t *u)
+{
+    return 0x60 | (u->rx_count ? 0x01 : 0x00);
+}
+
+/*!
+ * Reads the register \a off of UART \a u.
+ * \param u Pointer to the simulated UART.
+ * \param off Offset of the register.
+ */
+static int uart_read(sim_uart_t *u, int off)
+{
+    const int fifo = (u->fcr & 0x01) ? 0xC0 : 0x00; // IIR reports the enabled FIFO.
+    switch (off) {
+    case 0:
+        if (u->lcr & 0x80) {
+            return u->dll;
+        }
+        if (u->rx_count) {
+            u8 c = u->rx[u->rx_head];
+            u->rx_head = (u->rx_head + 1) % PIOSIM_FIFO;
+            u->rx_count--;
+            u->rx_time = now_clocks;
+            return c;
+        }
+        return 0;
+    case 1: return (u->lcr & 0x80) ? u->dlm : u->ier;
+    case 2: {
+        const int iir = uart_iir(u);
+        if (0x02 == iir) {
+            u->thre_pending = 0; // IIR clears the THRE interrupt on read.
+        }
+        return fifo | iir;
+    }
+    case 3: return u->lcr;
+    case 4: return u->mcr;
+    case 5: return uart_lsr(u);
+    case 6: return 0xB0; // DCD, DSR, CTS.
+    default: return u->scr;
+    }
+}
+
+/*!
+ * Writes \a value to the register \a off of UART \a u.
+ * \param u Pointer to the simulated UART.
+ * \param off Offset of the register.
+ * \param value Value.
+ */
+static void uart_write(sim_uart_t *u, int off, int value)
+{
+    switch (off) {
+    case 0:
+        if (u->lcr & 0x80) {
+            u->dll = value;
+        } else {
+            u->tx_count++;
+            u->thre_pending = 0;
+        }
+        break;
+    case 1:
+        if (u->lcr & 0x80) {
+            u->dlm = value;
+        } else {
+            u->ier = value & 0x0F;
+        }
+        break;
+    case 2:
+        if (value & 0x02) {
+            u->rx_count = 0;
+        }
+        u->fcr = value & 0xE9;
+        break;
+    case 3: u->lcr = value; break;
+    case 4: u->mcr = value & 0x1F; break; // 16550 has no ACE.
+    case 7: u->scr = value; break;
+    default:;
+    }
+}
+
+/*!
+ * Reads the word register of the peripheral control block at \a port.
+ * \param port Port address, 0xFF00 - 0xFFFF.
+ */
+static u16 pcb_read(int port)
+{
+    switch (port & 0xFFFE) {
+    case 0xFF58: // Timer 1 Count Register, the microsecond counter.
+        if (pcb[(0xFF5E & 0xFF) >> 1] & 0x8000) {
+            return (u16)(now_clocks / (PIOSIM_CPU_CLOCK / 1000000UL));
+        }
+        break;
+    case 0xFF80: return pgm.con;
+    case 0xFF82: return 0x0060 | (pgm.rx_full ? 0x0010 : 0x0000); // THRE, TEMT, RDR.
+    case 0xFF86:
+        pgm.rx_full = 0;
+        return pgm.rx;
+    case 0xFF88: return pgm.brd;
+    default:;
+    }
+    return pcb[(port & 0xFF) >> 1];
+}
+
+/*!
+ * Writes \a value to the word register of the peripheral control block at \a port.
+ * \param port Port address, 0xFF00 - 0xFFFF.
+ * \param value Value.
+ */
+static void pcb_write(int port, u16 value)
+{
+    switch (port & 0xFFFE) {
+    case 0xFF22: eois++; return; // EOI.
+    case 0xFF80: pgm.con = value; return;
+    case 0xFF82: return; // Status Register, the errors are cleared.
+    case 0xFF84: pgm.tx_count++; return;
+    case 0xFF88: pgm.brd = value; return;
+    default:;
+    }
+    pcb[(port & 0xFF) >> 1] = value;
+}
+
+/*!
+ * Counts one port access.
+ * \param write Not 0 for a write.
+ */
+static void count(int write)
+{
+    if (write) {
+        ++counters.writes;
+    } else {
+        ++counters.reads;
+    }
+    counters.clocks += PIOSIM_IO_CLOCKS;
+    now_clocks += PIOSIM_IO_CLOCKS;
+}
+
+//--------------------------------------------------------------------------------------------------------//
+/*** Public functions of "pio.h" ***/
+
+unsigned int inp(int port)
+{
+    count(0);
+    if (port >= 0xFF00) {
+        u16 w = pcb_read(port);
+        return (port & 1) ? (w >> 8) : (w & 0xFF);
+    }
+    int off;
+    sim_uart_t *u = uart_find(port, &off);
+    return (u) ? (uart_read(u, off)) : (0xFF);
+}
+
+unsigned int inpw(int port)
+{
+    if (port >= 0xFF00) { // Registers of 16 bits.
+        count(0);
+        return pcb_read(port);
+    }
+    return inp(port) | (inp(port + 1) << 8);
+}
+
+unsigned int outp(int port, int value)
+{
+    count(1);
+    if (port >= 0xFF00) {
+        pcb_write(port, (u16)(value & 0xFF));
+        return value;
+    }
+    int off;
+    sim_uart_t *u = uart_find(port, &off);
+    if (u) {
+        uart_write(u, off, value & 0xFF);
+    }
+    return value;
+}
+
+unsigned int outpw(int port, unsigned int value)
+{
+    if (port >= 0xFF00) { // Registers of 16 bits.
+        count(1);
+        pcb_write(port, (u16)value);
+        return value;
+    }
+    outp(port, value & 0xFF);
+    outp(port + 1, value >> 8);
+    return value;
+}
+
+pio_vect_t _dos_getvect(int intnum)
+{
+    return vects[intnum & 0xFF];
+}
+
+void _dos_setvect(int intnum, pio_vect_t handler)
+{
+    vects[intnum & 0xFF] = handler;
+}
+
+/*!
+ * Reads the counters of the port accesses.
+ * \param stats Pointer to the structure to which the counters are copied.
+ */
+void pio_get_stats(pio_stats_t *stats)
+{
+    *stats = counters;
+}
+
+/*!
+ * Resets the counters of the port accesses.
+ */
+void pio_reset_stats(void)
+{
+    memset(&counters, 0, sizeof(counters));
+}
+
+//--------------------------------------------------------------------------------------------------------//
+/*** Public functions of the simulator ***/
+
+/*!
+ * Resets the simulated devices and the counters of the port accesses.
+ * The interrupt vectors and the time are kept.
+ */
+void piosim_reset(void)
+{
+    memset(uarts, 0, sizeof(uarts));
+    memset(&pgm, 0, sizeof(pgm));
+    memset(pcb, 0, sizeof(pcb));
+    eois = 0;
+    pio_reset_stats();
+}
+
+/*!
+ * Puts the received bytes \a data of length \a len to the RX FIFO of \a uart.
+ * \param uart Simulated UART as piosim_uart_t.
+ * \param data A pointer to an array of bytes.
+ * \param len Number of bytes.
+ * \return Number of bytes accepted, the others are lost (overrun).
+ */
+int piosim_rx_inject(piosim_uart_t uart, const u8 *data, int len)
+{
+    int i = 0;
+    if (PIOSIM_PGM == uart) {
+        if (len && (!pgm.rx_full)) {
+            pgm.rx = data[i++];
+            pgm.rx_full = 1;
+        }
+        return i;
+    }
+    int off;
+    sim_uart_t *u = uart_find(uart, &off);
+    for (; u && (i < len) && (u->rx_count < PIOSIM_FIFO); ++i) {
+        u->rx[(u->rx_head + u->rx_count++) % PIOSIM_FIFO] = data[i];
+    }
+    if (u) {
+        u->rx_time = now_clocks;
+    }
+    return i;
+}
+
+/*!
+ * Returns number of bytes transmitted by \a uart.
+ * \param uart Simulated UART as piosim_uart_t.
+ */
+u32 piosim_tx_count(piosim_uart_t uart)
+{
+    if (PIOSIM_PGM == uart) {
+        return pgm.tx_count;
+    }
+    int off;
+    sim_uart_t *u = uart_find(uart, &off);
+    return (u) ? (u->tx_count) : (0);
+}
+
+/*!
+ * Makes the THRE interrupt of \a uart pending: the transmitter has sent
+ * the content of the TX FIFO.
+ * \param uart Simulated UART as piosim_uart_t, a 16550.
+ */
+void piosim_tx_ready(piosim_uart_t uart)
+{
+    int off;
+    sim_uart_t *u = uart_find(uart, &off);
+    if (u) {
+        u->thre_pending = 1;
+    }
+}
+
+/*!
+ * Returns not 0 if \a uart requests an interrupt: the pending interrupt
+ * enabled by IER, the RX interrupts by the trigger level and the Character Timeout.
+ * \param uart Simulated UART as piosim_uart_t, a 16550.
+ */
+int piosim_pending(piosim_uart_t uart)
+{
+    int off;
+    sim_uart_t *u = uart_find(uart, &off);
+    return (u) ? (0x01 != uart_iir(u)) : (0);
+}
+
+/*!
+ * Reads the register at \a port without side effects and without counting.
+ * For the UARTs 16550 the offsets 0 and 1 return the divisor latch,
+ * the offset 2 returns FCR.
+ * \param port Port address.
+ * \return Value of the register.
+ */
+int piosim_peek(int port)
+{
+    int off;
+    sim_uart_t *u = uart_find(port, &off);
+    if (u) {
+        switch (off) {
+        case 0: return u->dll;
+        case 1: return u->dlm;
+        case 2: return u->fcr;
+        case 5: return uart_lsr(u);
+        case 6: return 0xB0;
+        default: return uart_read(u, off);
+        }
+    }
+    if (port >= 0xFF00) {
+        switch (port & 0xFFFE) {
+        case 0xFF80: return pgm.con;
+        case 0xFF88: return pgm.brd;
+        default: return pcb[(port & 0xFF) >> 1];
+        }
+    }
+    return 0xFF;
+}
+
+/*!
+ * Calls the handler of the interrupt \a intnum, if it is installed and
+ * its source is not masked in the interrupt controller.
+ * \param intnum Interrupt number: 0x0C (INT0), 0x0E (INT2) or 0x14 (serial port of the CPU).
+ * \return -1 if the interrupt is masked or has not a handler.
+ */
+int piosim_interrupt(int intnum)
+{
+    u16 bit = 0;
+    switch (intnum) {
+    case 0x0C: bit = 0x0010; break;
+    case 0x0E: bit = 0x0040; break;
+    case 0x14: bit = 0x0400; break;
+    default:;
+    }
+    if ((pcb[(0xFF28 & 0xFF) >> 1] & bit) || (!vects[intnum & 0xFF])) {
+        return -1;
+    }
+    vects[intnum & 0xFF]();
+    return 0;
+}
+
+/*!
+ * Returns number of EOI written to the interrupt controller.
+ */
+u32 piosim_eois(void)
+{
+    return eois;
+}
+
+/*!
+ * Advances the simulated time by \a us.
+ * \param us Time, in us.
+ */
+void piosim_advance(u32 us)
+{
+    now_clocks += us * (PIOSIM_CPU_CLOCK / 1000000UL);
+}
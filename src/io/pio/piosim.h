@@ -0,0 +1,67 @@
+/*********************************************************************************************
+Project :
+Version :
+Date    : 17.10.2026
+Author  :
+Company :
+Comments: A library for work with the port I/O in your controllers ADAM 5000 series.
+License : New BSD
+**********************************************************************************************/
+
+/*! \file piosim.h
+ *
+ * This is the header file for the module implementation "piosim.cpp".
+ * This header file is declared interface to the control of the simulator
+ * of the port I/O, the host (Linux) backend of "pio.h".
+ */
+
+#ifndef PIOSIM_H
+#define PIOSIM_H
+
+#include "pio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Clock frequency of the simulated CPU, in Hz.
+ */
+#define PIOSIM_CPU_CLOCK 40000000UL
+
+/*!
+ * CPU clocks of one access to an external port (the instruction IN or OUT
+ * with the bus cycle of the 8 bit bus of Am188ES).
+ */
+#define PIOSIM_IO_CLOCKS 10
+
+/*!
+ * Depth of the FIFOs of the simulated UARTs 16550, in bytes.
+ */
+#define PIOSIM_FIFO 16
+
+/*!
+ * Base addresses of the simulated UARTs.
+ */
+typedef enum PIOSIM_UART {
+    PIOSIM_COM1 = 0x03F8, /*!< 16550 of COM1. */
+    PIOSIM_COM2 = 0x02F8, /*!< 16550 of COM2. */
+    PIOSIM_COM4 = 0x03E8, /*!< 16550 of COM4. */
+    PIOSIM_PGM  = 0xFF80  /*!< Internal UART of the CPU (COM_PGM), without FIFO. */
+} piosim_uart_t;
+
+void piosim_reset(void);
+int piosim_rx_inject(piosim_uart_t uart, const u8 *data, int len);
+u32 piosim_tx_count(piosim_uart_t uart);
+void piosim_tx_ready(piosim_uart_t uart);
+int piosim_pending(piosim_uart_t uart);
+int piosim_peek(int port);
+int piosim_interrupt(int intnum);
+u32 piosim_eois(void);
+void piosim_advance(u32 us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PIOSIM_H
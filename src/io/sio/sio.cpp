@@ -17,11 +17,11 @@ License : New BSD
  */
 
 #include "sio.h"
+#include "../tio/tio.h"
+#include "../pio/pio.h"
 
-#include <dos.h>
-#include <mem.h>
-#include <malloc.h>
-#include <conio.h>
+#include <string.h>
+#include <stdlib.h>
 
 
 //--------------------------------------------------------------------------------------------------------//
@@ -43,7 +43,10 @@ typedef enum SIO_OFFSET {
     SIO_OFFSET_MCR  = 4, /*!< Modem Control Register,            rw.           */
     SIO_OFFSET_LSR  = 5, /*!< Line Status Register,              ro.           */
     SIO_OFFSET_MSR  = 6, /*!< Modem Status Register,             ro.           */
-    SIO_OFFSET_SCR  = 7  /*!< Scratch Register,                  rw.           */
+    SIO_OFFSET_SCR  = 7, /*!< Scratch Register,                  rw.           */
+    SIO_OFFSET_EFR  = 2, /*!< Enhanced Features Register (16C950), rw, LCR = 0xBF. */
+    SIO_OFFSET_SPR  = 7, /*!< Scratch Pad Register (16C950), the index of ICR, wo. */
+    SIO_OFFSET_ICR  = 5  /*!< Indexed Control Register (16C950), rw, by SPR.    */
 } sio_offset_t;
 
 /*!
@@ -149,6 +152,34 @@ typedef enum SIO_LSR_B {
     SIO_LSR_ERF  = 0x80  /*!< Error in Received FIFO,             > 0x00. */
 } sio_lsr_b_t;
 
+/*!
+ * The values of the combinations of bits of the register EFR (16C950).
+ * Access: rw, when LCR = SIO_LCR_EFR_ACCESS.
+ */
+typedef enum SIO_EFR_B {
+    SIO_EFR_ECB  = 0x10, /*!< Enhanced mode,                    > 0x00. */
+    SIO_EFR_ARTS = 0x40, /*!< Automatic RTS flow control,       > 0x00. */
+    SIO_EFR_ACTS = 0x80  /*!< Automatic CTS flow control,       > 0x00. */
+} sio_efr_b_t;
+
+/*!
+ * Value of LCR, which gives access to EFR (16C950).
+ */
+#define SIO_LCR_EFR_ACCESS 0xBF
+
+/*!
+ * Indexes of the registers of 16C950, accessed through ICR.
+ */
+typedef enum SIO_ICR_IDX {
+    SIO_ICR_ACR = 0x00, /*!< Additional Control Register. */
+    SIO_ICR_ID1 = 0x08  /*!< Identification Register 1 (0x16 for 16C950). */
+} sio_icr_idx_t;
+
+/*!
+ * Bit of ACR, which enables the read of ICR (16C950).
+ */
+#define SIO_ACR_ICRRD 0x40
+
 /*!
  * The values of the combinations of bits of the register MSR.
  * Access: ro.
@@ -172,15 +203,39 @@ typedef enum SIO_MSR_B {
  *
  * Each direction of transmission in each a UART
  * has its own separate queue.
+ *
+ * The queue is a single-producer/single-consumer ring: the producer
+ * (the ISR for RX, the user code for TX) writes only \a in, and the
+ * consumer writes only \a out. One cell of the buffer always remains
+ * empty to distinguish a full queue from an empty one, so there is
+ * no shared counter and the data can be copied without disabling
+ * interrupts.
  */
 typedef struct SIO_QUEUE {
-    char *data; /*!< Queue data pointer. */
-    u16 size;   /*!< Maximum size of data buffer a queue. */
-    u16 in;     /*!< Index of where to store next character. */
-    u16 out;    /*!< Index of where to retrieve next character. */
-    u16 chars;  /*!< Count of characters in queue. */
+    char *data;        /*!< Queue data pointer. */
+    u16 size;          /*!< Size of data buffer a queue (capacity + 1). */
+    u16 mask;          /*!< Index mask (size - 1), if size is a power of two. */
+    volatile u16 in;   /*!< Index of where to store next character. */
+    volatile u16 out;  /*!< Index of where to retrieve next character. */
 } sio_queue_t;
 
+/*!
+ * Log2 of SIO_LARGE_BLOCK.
+ */
+#define LARGE_SHIFT 14
+
+/*!
+ * Large input queue: the ring buffer of the blocks of SIO_LARGE_BLOCK bytes,
+ * each block is in its own (far) segment. The indices are of 32 bits, so
+ * the user code reads and writes them with interrupts disabled.
+ */
+typedef struct SIO_LARGE {
+    char __far **blocks; /*!< Blocks of the buffer. */
+    u32 size;         /*!< Size of the buffer (capacity + 1). */
+    volatile u32 in;  /*!< Index of where to store next character (written by the ISR). */
+    volatile u32 out; /*!< Index of where to retrieve next character (written by the user code). */
+} sio_large_t;
+
 /*!
  * The structure of the store address registers of each UART.
  */
@@ -198,9 +253,39 @@ typedef struct SIO_ADDR {
  * Internal UART flags.
  */
 typedef enum FLAGS {
-    F_BLOCK_MODE = 0x0001 /*!< The flag state, which means that the port is open in blocking mode. */
+    F_BLOCK_MODE    = 0x0001, /*!< The flag state, which means that the port is open in blocking mode. */
+    F_POW2_BUFFERS  = 0x0002, /*!< The flag state, which means that the sizes of queues are a power of two. */
+    F_RX_BURST      = 0x0004, /*!< The flag state, which means that the RX FIFO is read by bursts. */
+    F_FIFO_ADAPTIVE = 0x0008, /*!< The flag state, which means that the RX FIFO trigger level is adaptive. */
+    F_RX_FRAMING    = 0x0010, /*!< The flag state, which means that the received bytes are split into frames. */
+    F_RX_NOTIFY     = 0x0020, /*!< The flag state, which means that the RX events are enabled. */
+    F_TX_ZC         = 0x0040, /*!< The flag state, which means that a zero-copy transfer is pending. */
+    F_RTS_FLOW      = 0x0080, /*!< The flag state, which means that RTS is driven by the input queue watermarks. */
+    F_CTS_FLOW      = 0x0100, /*!< The flag state, which means that the transmission is gated by CTS. */
+    F_RTS_OFF       = 0x0200, /*!< The flag state, which means that RTS is deasserted by the flow control. */
+    F_RS485         = 0x0400, /*!< The flag state, which means that the port is in the RS-485 half-duplex mode. */
+    F_RS485_TX      = 0x0800, /*!< The flag state, which means that the RS-485 driver is enabled (RTS asserted). */
+    F_STATIC        = 0x1000, /*!< The flag state, which means that the port uses the storage of the caller (sio_open_static()). */
+    F_RX_LARGE      = 0x2000, /*!< The flag state, which means that the large input queue is used (sio_set_rx_large()). */
+    F_POLLED        = 0x4000  /*!< The flag of open mode SIO_POLLED. */
 } flags_t;
 
+/*!
+ * Size of the frame index of each UART. One entry always remains empty.
+ */
+enum {
+    FRAMES = 8
+};
+
+/*!
+ * Entry of the frame index: a complete frame in the input queue.
+ */
+typedef struct SIO_FRAME {
+    u16 start; /*!< Index of the first character of the frame in the input queue. */
+    u16 len;   /*!< Length of the frame, in bytes. */
+    u16 crc;   /*!< CRC-16 of the frame, if computed by the ISR (0 for a frame with the valid CRC). */
+} sio_frame_t;
+
 /*!
  * UART structure.
 */
@@ -208,9 +293,84 @@ typedef struct SIO_UART {
     sio_addr_t addr; /*!< Structure in which stored UART addresses. */
     sio_queue_t rx;  /*!< Input queue. */
     sio_queue_t tx;  /*!< Output queue. */
+    sio_large_t large; /*!< Large input queue, used instead of rx with F_RX_LARGE. */
     int flags;       /*!< Flags (eg. open mode flag, and etc. */
+    int rx_trigger;  /*!< RX FIFO trigger level, in bytes. */
+    int fcr;         /*!< Current value of FCR (without the clear bits), FCR is write only. */
+    int tx_fifo;     /*!< Depth of the TX FIFO, in bytes. */
+    int type;        /*!< Type of UART as sio_uart_type_t. */
+    const int *levels; /*!< Table of the RX FIFO trigger levels, in bytes. */
+    int itl;         /*!< Index of the trigger level in the tables of levels. */
+    int adapt_irqs;  /*!< Adaptive trigger: RX interrupts in the current window. */
+    int adapt_rdto;  /*!< Adaptive trigger: timeout interrupts in the current window. */
+    int adapt_clean; /*!< Adaptive trigger: windows in a row without timeouts. */
+    int adapt_hold;  /*!< Adaptive trigger: windows without timeouts required to raise the level. */
+    sio_stats_t stats; /*!< Port statistics. */
+    u16 char_us;     /*!< Time of one character (start, data, parity, stop bits), in us. */
+    int char_bits;   /*!< Number of bits of one character (start, data, parity, stop bits). */
+    u32 bps;         /*!< Desired baud rate. */
+    u32 bps_real;    /*!< Real baud rate, by the divisor. */
+    int frame_half_chars; /*!< Framing: idle time which closes a frame, in half characters. */
+    u16 frame_idle;  /*!< Framing: idle time which closes a frame, in us. */
+    u16 rx_stamp;    /*!< Framing: time when the last character was received, in us. */
+    int frame_open;  /*!< Framing: not 0 if a frame is being received. */
+    int frame_rdto;  /*!< Framing: not 0 if the timeout interrupt closes the frames (the UART has FIFO, the idle time is up to 4 characters). */
+    int frame_ev;    /*!< Framing: not 0 if a frame is closed since the last SIO_EV_FRAME. */
+    u16 frame_start; /*!< Framing: index of the first character of the frame being received. */
+    sio_frame_t frames[FRAMES]; /*!< Framing: index of the complete frames (single-producer/single-consumer ring). */
+    volatile int frame_in;      /*!< Framing: index of where to store next frame (written by the ISR). */
+    volatile int frame_out;     /*!< Framing: index of where to retrieve next frame (written by the user code). */
+    int rx_crc_on;   /*!< Framing: not 0 if the ISR computes CRC-16 of the frames. */
+    u16 rx_crc;      /*!< Framing: CRC-16 of the frame being received. */
+    int rx_watermark;      /*!< RX events: number of bytes in the input queue, or 0 if disabled. */
+    int rx_delimiter;      /*!< RX events: delimiter character, or SIO_NO_DELIMITER. */
+    sio_notify_t notify;   /*!< RX events: callback, or 0. */
+    volatile int events;   /*!< RX events: pending events as sio_event_t. */
+    const char *zc_buf;    /*!< Zero-copy transfer: the buffer of the caller. */
+    const char *zc_data;   /*!< Zero-copy transfer: the next byte to transfer. */
+    volatile int zc_len;   /*!< Zero-copy transfer: number of bytes remaining. */
+    u16 zc_mark;           /*!< Zero-copy transfer: index of the output queue, where the transfer is inserted. */
+    sio_done_t zc_done;    /*!< Zero-copy transfer: completion callback, or 0. */
+    int rts_high;          /*!< Flow control: number of bytes in the input queue to deassert RTS. */
+    int rts_low;           /*!< Flow control: number of bytes in the input queue to assert RTS again. */
+    int hw_flow;           /*!< Flow control: not 0 if the UART drives RTS itself (16750 ACE, 16C950 EFR). */
+    u16 turnaround;        /*!< RS-485: time when the bus was released last time, in us. */
+    u16 echo;              /*!< RS-485: number of the transmitted bytes, whose echo is not received yet. */
+#ifdef SIO_TRACE
+    sio_trace_t trace;     /*!< Times of the ISR and of the sections with disabled interrupts. */
+#endif
 } sio_uart_t;
 
+#ifdef SIO_TRACE
+/*!
+ * Starts the measurement of a time, declares the variable \a t.
+ */
+#define TRACE_START(t) u16 t = tio_now()
+/*!
+ * Stops the measurement of the time started by TRACE_START(\a t) and adds it
+ * to the statistics \a what of UART \a u.
+ */
+#define TRACE_STOP(u, what, t) trace_add(&(u)->trace.what, (u16)(tio_now() - (t)))
+#else
+#define TRACE_START(t)
+#define TRACE_STOP(u, what, t)
+#endif
+
+#ifdef COM_PGM
+/*!
+ * Divisor of the vendor for a baud rate of the internal UART of the CPU.
+ */
+typedef struct SIO_PGM_DIVISOR {
+    u32 bps;  /*!< Baud rate. */
+    u16 div;  /*!< Value of the divisor register. */
+} sio_pgm_divisor_t;
+#endif
+
+/*!
+ * Check of the size of sio_port_storage_t at compile time.
+ */
+typedef char sio_storage_check_t[(sizeof(sio_port_storage_t) >= sizeof(sio_uart_t)) ? 1 : -1];
+
 //--------------------------------------------------------------------------------------------------------//
 /*** Private variables ***/
 
@@ -238,6 +398,86 @@ static sio_uart_t *uarts[4] = {0, 0, 0, 0};
  */
 static void (__interrupt *old_vecs[2])(void) = {0, 0};
 
+/*!
+ * Maximum number of UARTs, which share one interrupt line.
+ */
+#define SHARED_MAX 4
+
+/*!
+ * The open UARTs, which share one interrupt line.
+ */
+typedef struct SIO_SHARED {
+    sio_com_t ports[SHARED_MAX]; /*!< Port numbers. */
+    int cnt;                     /*!< Number of the ports. */
+} sio_shared_t;
+
+/*!
+ * The open UARTs on INT0 (COM1, COM4).
+ */
+static sio_shared_t int0 = {{SIO_COM1, SIO_COM1, SIO_COM1, SIO_COM1}, 0};
+
+/*!
+ * RX FIFO trigger levels of 16550, in bytes.
+ */
+static const int trigger_levels[4] = {1, 4, 8, 14};
+/*!
+ * RX FIFO trigger levels of 16750 with the 64 byte FIFO, in bytes.
+ */
+static const int trigger_levels_64[4] = {1, 16, 32, 56};
+/*!
+ * RX "trigger levels" of UARTs without FIFO.
+ */
+static const int trigger_levels_none[4] = {1, 1, 1, 1};
+/*!
+ * FCR bits of the trigger levels.
+ */
+static const int trigger_bits[4] = {SIO_FCR_ITL1, SIO_FCR_ITL4, SIO_FCR_ITL8, SIO_FCR_ITL14};
+/*!
+ * Table of CRC-16 (Modbus, polynomial 0xA001 reflected) by one byte.
+ */
+static const u16 crc_table[256] = {
+    0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+    0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+    0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+    0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+    0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+    0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+    0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+    0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+    0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+    0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+    0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+    0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+    0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+    0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+    0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+    0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+    0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+    0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+    0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+    0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+    0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+    0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+    0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+    0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+    0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+    0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+    0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+    0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+    0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+    0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+    0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+    0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040
+};
+
+/*!
+ * Parameters of the adaptive RX FIFO trigger level.
+ */
+enum {
+    ADAPT_WINDOW   = 16, /*!< Number of RX interrupts in a window. */
+    ADAPT_HOLD_MAX = 64  /*!< Maximum of windows without timeouts required to raise the level. */
+};
+
 #ifdef COM_PGM
 /*!
  * Pointer to the PGM old interrupt vector.
@@ -255,6 +495,14 @@ static int old_lcr = 0;
  * PGM old state.
  */
 static int old_brd = 0;
+/*!
+ * Divisors of the vendor for the rates of sio_speed_t by the CPU clock
+ * SIO_CLOCK_PGM, they differ from the nearest divisors for some rates.
+ */
+static const sio_pgm_divisor_t pgm_divisors[] = {
+    {50UL, 24999}, {300UL, 4165}, {600UL, 2082}, {2400UL, 519}, {4800UL, 259},
+    {9600UL, 129}, {19200UL, 64}, {38400UL, 31}, {57600UL, 20}, {115200UL, 9}
+};
 #endif
 
 //--------------------------------------------------------------------------------------------------------//
@@ -266,411 +514,3027 @@ int sioerrno = SIO_ERR_NONE;
 /*** Private functions ***/
 
 /*!
- * Interrupt sub-handler a concrete of port \a nport.
- * \param nport Port number as sio_com_t.
+ * Returns number of characters in queue \a q.
+ * \param q Pointer to the queue.
  */
-static void com_vce_isr(sio_com_t nport)
+static int queue_chars(const sio_queue_t *q)
 {
-    int r;
-    while (!(SIO_IIR_IP & (r = inp(uarts[nport]->addr.iir_fcr)))) {
+    int chars = q->in - q->out;
+    return (chars < 0) ? (chars + q->size) : (chars);
+}
 
-        switch (SIO_IIR_ID_MASK & r) {
+/*!
+ * Returns number of free cells in queue \a q.
+ * \param q Pointer to the queue.
+ */
+static int queue_free(const sio_queue_t *q)
+{
+    return (q->size - 1) - queue_chars(q);
+}
 
-        /* Modem Status Interrupt */
-        case SIO_IIR_MSI:
-            inp(uarts[nport]->addr.msr); // Just clear the interrupt
-            break;
+/*!
+ * Copies \a len characters from the beginning of queue \a q
+ * to \a buf and releases them.
+ * \param q Pointer to the queue.
+ * \param pow2 Not 0 if the size of the queue is a power of two.
+ * \param buf A pointer to an array of bytes.
+ * \param len Number of bytes to copy, no more than queue_chars().
+ */
+static void queue_get(sio_queue_t *q, int pow2, char *buf, int len)
+{
+    u16 out = q->out;
 
-            /* Receiver Line Status Register */
-        case SIO_IIR_RLSI:
-            inp(uarts[nport]->addr.lsr); // Just clear the interrupt
-            break;
+    // How many to copy to the ring buffer?
+    // It is on the border of the ring buffer?
+    int sizecpy = ((out + len) <= q->size) ? (len) : (q->size - out);
 
-            /* Empty Transmitter Holding Register */
-        case SIO_IIR_THREI:
-            if (SIO_LSR_ETHR & inp(uarts[nport]->addr.lsr)) {
-                // Transfer a maximum 16 byte.
-                // Use r variable as iterator (for economy).
-                for (r = 0; (r < 16) && (uarts[nport]->tx.chars > 0); ++r, uarts[nport]->tx.chars--) {
-                    outp(uarts[nport]->addr.base, uarts[nport]->tx.data[uarts[nport]->tx.out++]);
-                    if (uarts[nport]->tx.out == uarts[nport]->tx.size) {
-                        uarts[nport]->tx.out = 0; // Number of bytes in tx queue.
-                    }
-                }
-            }
-            break;
+    // Copy to the boundary of the ring buffer.
+    memcpy(buf, q->data + out, sizecpy);
 
-            //case SIO_IIR_RDAI: /* Received Data Ready */
-            // Read from the FIFO 14-byte expected, as interrupt is set to every 14 bytes.
-            //   for (int i = 0; i < 14; ++i) {
-            //        char c = inp(uarts[nport]->addr.base); // Read byte from UART.
-            //        if (uarts[nport]->rx.chars < uarts[nport]->rx.size) {
-            //
-            //            uarts[nport]->rx.data[uarts[nport]->rx.in++] = c;
-            //
-            //            if (uarts[nport]->rx.in == uarts[nport]->rx.size)
-            //                uarts[nport]->rx.in = 0;
-            //
-            //            uarts[nport]->rx.chars++;
-            //        }
-            //        if (0 == (inp(uarts[nport]->addr.lsr) & SIO_LSR_DR))
-            //            break; /*Data Ready > 0x00. */
-            //   }
-            //    break;
-
-
-            /* Received Data Ready or Receive Data time out */
-        case SIO_IIR_RDAI:
-        case SIO_IIR_RDTO:
-            while (SIO_LSR_DR & inp(uarts[nport]->addr.lsr)) { // Data Ready > 0x00
-                // Use r variable as read result (for economy).
-                r = inp(uarts[nport]->addr.base); // Read byte from UART.
-                if (uarts[nport]->rx.chars < uarts[nport]->rx.size) {
-                    uarts[nport]->rx.data[uarts[nport]->rx.in++] = (char)r;
-                    if (uarts[nport]->rx.in == uarts[nport]->rx.size) {
-                        uarts[nport]->rx.in = 0;
-                    }
-                    uarts[nport]->rx.chars++;
-                }
-            }
-            break;
+    if (sizecpy < len) { // This is not all?
+        sizecpy = len - sizecpy; // Compute the remainder.
+        out = 0; // Beginning of the buffer.
+        // Copy the remainder to the beginning of the ring buffer.
+        memcpy(buf + (len - sizecpy), q->data, sizecpy);
+    }
 
-        default:;
-        }//sw
+    out += sizecpy; // A pointer to an next empty cell, the ring buffer.
 
-    }//while
+    // A pointer to an empty cell, the ring buffer outside the buffer size?
+    if (pow2) {
+        out &= q->mask;
+    } else if (out >= q->size) {
+        out = 0;
+    }
+
+    // Release the cells for the producer.
+    q->out = out;
 }
 
 /*!
- * COM1/COM4 interrupt handler.
+ * Rounds up \a size to the nearest power of two.
+ * \param size Size of a queue buffer, no more than 0x4000.
  */
-static void __interrupt handler1_4(void)
+static int round_pow2(int size)
 {
-    _enable();
-    if (uarts[SIO_COM1]) {
-        com_vce_isr(SIO_COM1);
+    int pow2 = 1;
+    while (pow2 < size) {
+        pow2 <<= 1;
     }
-    if (uarts[SIO_COM4]) {
-        com_vce_isr(SIO_COM4);
-    }
-    // Reset the external interrupt INT0 UART,
-    // where 0x000C - EOI (End Of Interrupt)
-    outpw(0xFF22, 0x000C);
+    return pow2;
 }
 
 /*!
- * COM2 interrupt handler.
+ * Stores the received character \a c to the input queue of UART \a u.
+ * \param u Pointer to the UART structure.
+ * \param c Received character.
  */
-static void __interrupt handler2(void)
+static inline void rx_put(sio_uart_t *u, int c)
 {
-    _enable();
-    if (uarts[SIO_COM2]) {
-        com_vce_isr(SIO_COM2);
+    u->stats.rx_bytes++;
+    u16 next = u->rx.in + 1;
+    if (next == u->rx.size) {
+        next = 0;
+    }
+    if (next != u->rx.out) { // Queue is not full?
+        u->rx.data[u->rx.in] = (char)c;
+        u->rx.in = next; // Publish the character.
+    } else {
+        u->stats.rx_dropped++;
     }
-    // Reset the external interrupt INT2 UART,
-    // where 0x000E - EOI (End Of Interrupt)
-    outpw(0xFF22, 0x000E);
 }
 
-#ifdef COM_PGM
-
 /*!
- * PGM interrupt handler.
+ * Same as rx_put(), for the input queue with the size of a power of two.
+ * \param u Pointer to the UART structure.
+ * \param c Received character.
  */
-static void __interrupt handler_pgm(void)
+static inline void rx_put_pow2(sio_uart_t *u, int c)
 {
-    _enable();
-    int r = inpw(uarts[SIO_COM_PGM]->addr.lsr);
-    if ((0x000F & r) == 0) {
-        //новое
-        //передача
-        if (0x0060 & r) {
-            if ( 0 == uarts[SIO_COM_PGM]->tx.chars) {
-                // Enf of transmission.
-                outpw(uarts[SIO_COM_PGM]->addr.lcr, inpw(uarts[SIO_COM_PGM]->addr.lcr) & 0xF7FF);
-            } else {
-                outp(uarts[SIO_COM_PGM]->addr.iir_fcr, uarts[SIO_COM_PGM]->tx.data[uarts[SIO_COM_PGM]->tx.out++]);
-                if (uarts[SIO_COM_PGM]->tx.out == uarts[SIO_COM_PGM]->tx.size) {
-                    uarts[SIO_COM_PGM]->tx.out = 0; // Number of bytes in tx queue.
-                }
-                uarts[SIO_COM_PGM]->tx.chars--;
-            }
-        }
-        // Receive.
-        if (0x0010 & r) {
-            r = inpw(uarts[SIO_COM_PGM]->addr.base);
-            if (uarts[SIO_COM_PGM]->rx.chars < uarts[SIO_COM_PGM]->rx.size) {
-                uarts[SIO_COM_PGM]->rx.data[uarts[SIO_COM_PGM]->rx.in++] = (char)r;
-                if (uarts[SIO_COM_PGM]->rx.in == uarts[SIO_COM_PGM]->rx.size) {
-                    uarts[SIO_COM_PGM]->rx.in = 0;
-                }
-                uarts[SIO_COM_PGM]->rx.chars++;
-            }
-        }
+    u->stats.rx_bytes++;
+    u16 next = (u->rx.in + 1) & u->rx.mask;
+    if (next != u->rx.out) { // Queue is not full?
+        u->rx.data[u->rx.in] = (char)c;
+        u->rx.in = next; // Publish the character.
     } else {
-        //If have errors then reset it.
-        outpw(uarts[SIO_COM_PGM]->addr.lsr, 0x00F0 & r);
+        u->stats.rx_dropped++;
     }
-    // Reset interrupt from the internal UART CPU,
-    // where 0x0014 - EOI (End Of Interrupt)
-    outpw(0xFF22, 0x0014);
 }
 
-#endif //COM_PGM
-
-//--------------------------------------------------------------------------------------------------------//
-/*** Public functions ***/
-
+#ifdef SIO_TRACE
 /*!
- * Opens port \a nport with the desired \a mode.
- * In the process of opening create internal an input and an
- * output buffer of the specified size \a tx_buf_size and \a rx_buf_size.
- * \param nport Port number as sio_com_t.
- * \param mode Open mode as sio_mode_t.
- * \param tx_buf_size Size of the output buffer of port, in bytes.
- * \param rx_buf_size Size of the input buffer of port, in bytes.
- * \return -1 on error.
+ * Adds the time \a us to the statistics of the times \a ts.
+ * \param ts Pointer to the statistics.
+ * \param us Time, in us.
  */
-int sio_open(sio_com_t nport, sio_mode_t mode, int tx_buf_size, int rx_buf_size)
+static void trace_add(sio_trace_stat_t *ts, u16 us)
 {
-    if (uarts[nport]) {
-        sioerrno = SIO_ERR_PORT_ALREADY_OPEN;
-        return -1;
+    if ((!ts->count) || (us < ts->min)) {
+        ts->min = us;
     }
-
-    // Create internel port structure.
-    uarts[nport] = (sio_uart_t *)calloc(1, sizeof(sio_uart_t));
-    if (!uarts[nport]) {
-        sioerrno = SIO_ERR_NOT_MEMORY;
-        return -1;
+    if (us > ts->max) {
+        ts->max = us;
     }
-
-    // Create output port buffer.
-    uarts[nport]->tx.data = (char *)calloc(1, tx_buf_size);
-    if (uarts[nport]->tx.data) {
-        // Create input port buffer.
-        uarts[nport]->rx.data = (char *)calloc(1, rx_buf_size);
-        if (!uarts[nport]->rx.data) {
-            free(uarts[nport]->tx.data);
-            uarts[nport]->tx.data = 0;
-        }
+    ts->count++;
+    int b = 0;
+    for (u16 v = us >> 1; v && (b < (SIO_TRACE_BUCKETS - 1)); v >>= 1) {
+        ++b;
     }
+    ts->hist[b]++;
+}
+#endif
 
-    // Check existing a input and output buffers.
-    if (!(uarts[nport]->tx.data)) {
-        free(uarts[nport]);
-        uarts[nport] = 0;
-        sioerrno = SIO_ERR_NOT_MEMORY;
-        return -1;
+/*!
+ * Same as rx_put(), for the large input queue.
+ * \param u Pointer to the UART structure.
+ * \param c Received character.
+ */
+static inline void rx_put_large(sio_uart_t *u, int c)
+{
+    u->stats.rx_bytes++;
+    u32 next = u->large.in + 1;
+    if (next == u->large.size) {
+        next = 0;
+    }
+    if (next != u->large.out) { // Queue is not full?
+        u->large.blocks[(int)(u->large.in >> LARGE_SHIFT)][(u16)u->large.in & (SIO_LARGE_BLOCK - 1)] = (char)c;
+        u->large.in = next; // Publish the character.
+    } else {
+        u->stats.rx_dropped++;
     }
+}
 
-    // Save buffers size.
-    uarts[nport]->rx.size = rx_buf_size;
-    uarts[nport]->tx.size = tx_buf_size;
+/*!
+ * Returns number of characters in the large queue \a q.
+ * The user code must call it with interrupts disabled.
+ * \param q Pointer to the large queue.
+ */
+static u32 large_chars(const sio_large_t *q)
+{
+    return (q->in >= q->out) ? (q->in - q->out) : (q->in + q->size - q->out);
+}
 
-    sioerrno = SIO_ERR_NONE;
+/*!
+ * Copies no more than \a len characters from the beginning of the large
+ * queue of UART \a u to \a buf and releases them. Called by the user code.
+ * \param u Pointer to the UART structure.
+ * \param buf A pointer to an array of bytes.
+ * \param len Maximum number of bytes to copy.
+ * \return Number of bytes copied.
+ */
+static int large_get(sio_uart_t *u, char *buf, int len)
+{
+    sio_large_t *q = &u->large;
+    _disable();
+    TRACE_START(t);
+    u32 chars = large_chars(q);
+    TRACE_STOP(u, masked, t);
+    _enable();
+    if (chars > (u32)len) {
+        chars = len;
+    }
 
-    // Set open mode.
-    if (SIO_BLOCK_MODE == mode) {
-        uarts[nport]->flags |= F_BLOCK_MODE;
+    // The queue can only get more data while we copy,
+    // the copy is done by the pieces up to the border of a block.
+    u32 out = q->out;
+    int n = (int)chars;
+    while (n) {
+        u16 offset = (u16)out & (SIO_LARGE_BLOCK - 1);
+        int sizecpy = SIO_LARGE_BLOCK - offset;
+        if (sizecpy > n) {
+            sizecpy = n;
+        }
+        _fmemcpy(buf, q->blocks[(int)(out >> LARGE_SHIFT)] + offset, sizecpy);
+        buf += sizecpy;
+        n -= sizecpy;
+        out += sizecpy;
+        if (out >= q->size) {
+            out = 0;
+        }
     }
 
-#ifdef COM_PGM // PGM configure.
+    // Release the cells for the ISR.
+    _disable();
+    TRACE_START(t2);
+    q->out = out;
+    TRACE_STOP(u, masked, t2);
+    _enable();
+    return (int)chars;
+}
 
-    if (SIO_COM_PGM == nport) {
-        // Addresses of RX and TX registers.
-        uarts[SIO_COM_PGM]->addr.base = 0xFF86;    // Receive Register.
-        uarts[SIO_COM_PGM]->addr.iir_fcr = 0xFF84; // Transmit Register.
-        // Addresses of control regisrets.
-        uarts[SIO_COM_PGM]->addr.ier = 0xFF44; // Interrupt Control Register.
-        uarts[SIO_COM_PGM]->addr.lcr = 0xFF80; // Control Register.
-        uarts[SIO_COM_PGM]->addr.lsr = 0xFF82; // Status Register.
-        uarts[SIO_COM_PGM]->addr.mcr = 0xFF88; // Baud Rate Divisor Register.
+/*!
+ * Returns number of characters in the input queue of UART \a u,
+ * no more than 0x7FFF. Called by the user code.
+ * \param u Pointer to the UART structure.
+ */
+static int rx_chars(sio_uart_t *u)
+{
+    if (F_RX_LARGE & u->flags) {
         _disable();
-        // Save old registers state.
-        old_ier = inpw(uarts[SIO_COM_PGM]->addr.ier);
-        old_lcr = inpw(uarts[SIO_COM_PGM]->addr.lcr);
-        old_brd = inpw(uarts[SIO_COM_PGM]->addr.mcr); // Old baud rate.
-        // Interrupts.
-        outpw(0xFF28, (inpw(0xFF28) | intmasks[SIO_COM_PGM])); // Disable UART interrupts.
+        u32 chars = large_chars(&u->large);
         _enable();
-        old_vec_pgm = _dos_getvect(intnums[SIO_COM_PGM]); // Save old interrupt vector.
-        _dos_setvect(intnums[SIO_COM_PGM], handler_pgm);  // Set new interrupt vector.
-        // Configuring.
-        outpw(uarts[SIO_COM_PGM]->addr.lcr, 0x0417); // RXIE, WLGN, TMOD, RSIE, RMODE.
-        outpw(0xFF22, 0x0014);// Reset UART interrupts.
-        outpw(uarts[SIO_COM_PGM]->addr.ier, 0x0017);// Interrupt enable
-        outpw(0xFF28, inpw(0xFF28) & (~intmasks[SIO_COM_PGM]));// Enable UART interrupts.
-        return 0;
+        return (chars > 0x7FFF) ? (0x7FFF) : ((int)chars);
     }
+    return queue_chars(&u->rx);
+}
 
-#endif
+/*!
+ * Updates the peak number of bytes in the input queue of UART \a u.
+ * \param u Pointer to the UART structure.
+ */
+static inline void rx_update_peak(sio_uart_t *u)
+{
+    u16 chars = queue_chars(&u->rx);
+    if (F_RX_LARGE & u->flags) {
+        u32 n = large_chars(&u->large);
+        chars = (n > 0xFFFF) ? (0xFFFF) : ((u16)n);
+    }
+    if (chars > u->stats.rx_peak) {
+        u->stats.rx_peak = chars;
+    }
+}
 
-    // "Standard" UART configure.
-    uarts[nport]->addr.base = bases[nport];
-    uarts[nport]->addr.ier = bases[nport] + SIO_OFFSET_IER;
-    uarts[nport]->addr.iir_fcr = bases[nport] + SIO_OFFSET_IIR;
-    uarts[nport]->addr.lcr = bases[nport] + SIO_OFFSET_LCR;
-    uarts[nport]->addr.mcr = bases[nport] + SIO_OFFSET_MCR;
-    uarts[nport]->addr.lsr = bases[nport] + SIO_OFFSET_LSR;
-    uarts[nport]->addr.msr = bases[nport] + SIO_OFFSET_MSR;
+/*!
+ * Counts the receive errors reported by the value \a lsr of LSR
+ * of the "standard" UART \a u (LSR clears them on read).
+ * \param u Pointer to the UART structure.
+ * \param lsr Value of LSR.
+ */
+static inline void lsr_errors(sio_uart_t *u, int lsr)
+{
+    if (lsr & (SIO_LSR_OE | SIO_LSR_PE | SIO_LSR_FE | SIO_LSR_BI)) {
+        if (SIO_LSR_OE & lsr) {
+            u->stats.rx_overruns++;
+        }
+        if (SIO_LSR_BI & lsr) { // A break is reported with the framing error.
+            u->stats.rx_breaks++;
+        } else {
+            if (SIO_LSR_PE & lsr) {
+                u->stats.rx_parity_errors++;
+            }
+            if (SIO_LSR_FE & lsr) {
+                u->stats.rx_framing_errors++;
+            }
+        }
+    }
+}
 
-    outp(uarts[nport]->addr.ier, 0x00);// Disable interrupt.
-    // Check UART exists.
-    if (inp(uarts[nport]->addr.ier)) {
-        free(uarts[nport]->tx.data);
-        free(uarts[nport]->rx.data);
-        free(uarts[nport]);
-        uarts[nport] = 0;
-        sioerrno = SIO_ERR_NO_UART;
-        return -1;
+/*!
+ * Reads the RX FIFO of the "standard" UART \a u into the input queue.
+ * At first \a blind bytes are read without polling LSR (the caller
+ * knows that the FIFO holds them), then the tail is read while
+ * LSR reports Data Ready.
+ * \param u Pointer to the UART structure.
+ * \param blind Number of bytes to read without polling LSR.
+ * \param tail Not 0 to read the tail, else the rest is left in the FIFO.
+ */
+static void rx_drain(sio_uart_t *u, int blind, int tail)
+{
+    int r;
+    if (F_RX_LARGE & u->flags) {
+        for (r = blind; r > 0; --r) {
+            rx_put_large(u, inp(u->addr.base));
+        }
+        while (tail && (SIO_LSR_DR & (r = inp(u->addr.lsr)))) { // Data Ready > 0x00
+            lsr_errors(u, r);
+            rx_put_large(u, inp(u->addr.base));
+            u->stats.rx_polled_bytes++;
+        }
+    } else if (F_POW2_BUFFERS & u->flags) {
+        for (r = blind; r > 0; --r) {
+            rx_put_pow2(u, inp(u->addr.base));
+        }
+        while (tail && (SIO_LSR_DR & (r = inp(u->addr.lsr)))) { // Data Ready > 0x00
+            lsr_errors(u, r);
+            rx_put_pow2(u, inp(u->addr.base));
+            u->stats.rx_polled_bytes++;
+        }
+    } else {
+        for (r = blind; r > 0; --r) {
+            rx_put(u, inp(u->addr.base));
+        }
+        while (tail && (SIO_LSR_DR & (r = inp(u->addr.lsr)))) { // Data Ready > 0x00
+            lsr_errors(u, r);
+            rx_put(u, inp(u->addr.base));
+            u->stats.rx_polled_bytes++;
+        }
     }
+    lsr_errors(u, r);
+    rx_update_peak(u);
+}
 
-    // Configure FIFO.
-    outp(uarts[nport]->addr.iir_fcr, SIO_FCR_CRF | SIO_FCR_CTF); // Clear FIFO.
-    outp(uarts[nport]->addr.iir_fcr, 0xC0);                      // Set FIFO's trigger level = 14.
-    outp(uarts[nport]->addr.iir_fcr, SIO_FCR_EF);                // Enable FIFO.
+/*!
+ * Deasserts RTS of the "standard" UART \a u, if the input queue
+ * has reached the high watermark. Called by the ISR.
+ * \param u Pointer to the UART structure.
+ */
+static void rx_throttle(sio_uart_t *u)
+{
+    if ((!(F_RTS_OFF & u->flags)) && (queue_chars(&u->rx) >= u->rts_high)) {
+        outp(u->addr.mcr, inp(u->addr.mcr) & (~SIO_MCR_FRS));
+        u->flags |= F_RTS_OFF;
+    }
+}
 
-    // FIXME: Finish in the future.
-    /*if (var_2 == 1)
-    {
+/*!
+ * Asserts RTS of port \a nport again, if RTS has been deasserted by
+ * the flow control and the input queue has fallen to the low watermark.
+ * Called by the user code after the cells of the input queue are released.
+ * \param nport Port number as sio_com_t.
+ */
+static void rx_release(sio_com_t nport)
+{
+    if ((F_RTS_OFF & uarts[nport]->flags) && (queue_chars(&uarts[nport]->rx) <= uarts[nport]->rts_low)) {
         _disable();
-        if ((inp(0x0178) & 0x80)==0)
-        {
-            if (inp( uarts[nport]->addr.lcr) != 0xBF)
-            {
-                outp(var_e, 0x00);
-                outp(var_10, 0x18);
+        TRACE_START(t);
+        outp(uarts[nport]->addr.mcr, inp(uarts[nport]->addr.mcr) | SIO_MCR_FRS);
+        uarts[nport]->flags &= ~F_RTS_OFF;
+        TRACE_STOP(uarts[nport], masked, t);
+        _enable();
+    }
+}
+
+/*!
+ * Writes FCR of the "standard" UART \a u, if its FIFO is enabled.
+ * While the RS-485 driver is enabled the RX FIFO trigger level is 1, so the
+ * echo of each transmitted byte is an interrupt and the bus is released
+ * within one character after the end of the transmission.
+ * \param u Pointer to the UART structure.
+ */
+static void fifo_write(sio_uart_t *u)
+{
+    if (SIO_FCR_EF & u->fcr) {
+        outp(u->addr.iir_fcr, (F_RS485_TX & u->flags) ? ((u->fcr & (~SIO_FCR_ITL_MASK)) | SIO_FCR_ITL1) : (u->fcr));
+    }
+}
+
+/*!
+ * Sets the RX FIFO trigger level with index \a itl in the tables of levels
+ * of the "standard" UART \a u.
+ * \param u Pointer to the UART structure.
+ * \param itl Index of the trigger level.
+ */
+static void fifo_set_trigger(sio_uart_t *u, int itl)
+{
+    u->itl = itl;
+    u->rx_trigger = u->levels[itl];
+    u->fcr = (u->fcr & (~SIO_FCR_ITL_MASK)) | trigger_bits[itl];
+    fifo_write(u);
+}
+
+/*!
+ * Writes \a efr to EFR of the UART 16C950 \a u.
+ * \param u Pointer to the UART structure.
+ * \param efr Value of EFR.
+ */
+static void efr_write(sio_uart_t *u, int efr)
+{
+    int lcr = inp(u->addr.lcr);
+    outp(u->addr.lcr, SIO_LCR_EFR_ACCESS);
+    outp(u->addr.base + SIO_OFFSET_EFR, efr);
+    outp(u->addr.lcr, lcr);
+}
+
+/*!
+ * Detects the type of the "standard" UART \a u.
+ *
+ * 8250 has no scratch register. 16450 has no FIFO, and 16550 reports
+ * the FIFO in IIR, but it is not reliable. 16C950 has EFR behind LCR = 0xBF
+ * and the identification registers behind ICR. 16750 accepts the bit
+ * SIO_FCR_EBF64 (written only when DLAB = 1) and reports it in IIR by
+ * the bit 0x20. All other UARTs with the working FIFO are 16550A.
+ * \note FIFO is left in undefined state.
+ * \param u Pointer to the UART structure.
+ * \return Type of UART as sio_uart_type_t.
+ */
+static int uart_detect(sio_uart_t *u)
+{
+    const u16 scr = u->addr.base + SIO_OFFSET_SCR;
+    int r;
+
+    // Scratch register.
+    outp(scr, 0x55);
+    r = inp(scr);
+    outp(scr, 0xAA);
+    if ((0x55 != r) || (0xAA != inp(scr))) {
+        return SIO_UART_8250;
+    }
+
+    // FIFO.
+    outp(u->addr.iir_fcr, SIO_FCR_EF);
+    r = inp(u->addr.iir_fcr) & 0xC0;
+    if (0x80 == r) {
+        return SIO_UART_16550;
+    }
+    if (0xC0 != r) {
+        return SIO_UART_16450;
+    }
+
+    // EFR and the identification of 16C950.
+    int lcr = inp(u->addr.lcr);
+    outp(u->addr.lcr, SIO_LCR_EFR_ACCESS);
+    outp(u->addr.base + SIO_OFFSET_EFR, SIO_EFR_ECB);
+    r = inp(u->addr.base + SIO_OFFSET_EFR);
+    outp(u->addr.base + SIO_OFFSET_EFR, 0x00);
+    outp(u->addr.lcr, lcr);
+    if (SIO_EFR_ECB == r) {
+        outp(u->addr.base + SIO_OFFSET_SPR, SIO_ICR_ACR);
+        outp(u->addr.base + SIO_OFFSET_ICR, SIO_ACR_ICRRD); // Enable read of ICR.
+        outp(u->addr.base + SIO_OFFSET_SPR, SIO_ICR_ID1);
+        r = inp(u->addr.base + SIO_OFFSET_ICR);
+        outp(u->addr.base + SIO_OFFSET_SPR, SIO_ICR_ACR);
+        outp(u->addr.base + SIO_OFFSET_ICR, 0x00);
+        if (0x16 == r) {
+            return SIO_UART_16C950;
+        }
+    }
+
+    // 64 byte FIFO of 16750.
+    outp(u->addr.lcr, (lcr | SIO_LCR_DLAB));
+    outp(u->addr.iir_fcr, SIO_FCR_EF | SIO_FCR_EBF64);
+    outp(u->addr.lcr, lcr);
+    r = inp(u->addr.iir_fcr);
+    outp(u->addr.lcr, (lcr | SIO_LCR_DLAB));
+    outp(u->addr.iir_fcr, SIO_FCR_EF);
+    outp(u->addr.lcr, lcr);
+    return (0x20 & r) ? (SIO_UART_16750) : (SIO_UART_16550A);
+}
+
+/*!
+ * Configures FIFO of the "standard" UART \a u by its type:
+ * 16750 works with 64 byte FIFO, 16550A and 16C950 with 16 byte FIFO
+ * (16C950 in the compatible mode), other UARTs without FIFO.
+ * \param u Pointer to the UART structure.
+ */
+static void fifo_init(sio_uart_t *u)
+{
+    switch (u->type) {
+    case SIO_UART_16750:
+        // The bit SIO_FCR_EBF64 is written only when DLAB = 1.
+        outp(u->addr.lcr, (inp(u->addr.lcr) | SIO_LCR_DLAB));
+        outp(u->addr.iir_fcr, SIO_FCR_EF | SIO_FCR_EBF64 | SIO_FCR_CRF | SIO_FCR_CTF); // Clear FIFO.
+        outp(u->addr.lcr, (inp(u->addr.lcr) & (~SIO_LCR_DLAB)));
+        u->fcr = SIO_FCR_EF | SIO_FCR_EBF64;
+        u->tx_fifo = 64;
+        u->levels = trigger_levels_64;
+        break;
+    case SIO_UART_16550A:
+    case SIO_UART_16C950:
+        outp(u->addr.iir_fcr, SIO_FCR_EF | SIO_FCR_CRF | SIO_FCR_CTF); // Clear FIFO.
+        u->fcr = SIO_FCR_EF;
+        u->tx_fifo = 16;
+        u->levels = trigger_levels;
+        break;
+    default:
+        outp(u->addr.iir_fcr, 0x00); // Disable FIFO.
+        u->fcr = 0;
+        u->tx_fifo = 1;
+        u->levels = trigger_levels_none;
+    }
+    // The bits of FCR are written only together with SIO_FCR_EF,
+    // so the trigger level is set in the same write as the enable.
+    fifo_set_trigger(u, 3); // Enable FIFO, maximum trigger level.
+}
+
+/*!
+ * Returns the index of the lowest RX FIFO trigger level of the "standard" UART \a u.
+ * In the framing mode with the timeout interrupt the level 1 is not used: the last
+ * character is left in the FIFO, so the timeout interrupt comes when the line gets idle.
+ * \param u Pointer to the UART structure.
+ */
+static int fifo_min_itl(const sio_uart_t *u)
+{
+    return ((F_RX_FRAMING & u->flags) && u->frame_rdto) ? (1) : (0);
+}
+
+/*!
+ * Adapts the RX FIFO trigger level of the "standard" UART \a u to the traffic.
+ * Called by the ISR on each RX interrupt.
+ *
+ * The timeout interrupts mean that the data waited in the FIFO below the trigger
+ * level (the traffic is sparse), so the level is lowered at once if they are
+ * frequent. The windows without timeouts mean a sustained stream, so the level
+ * is raised after \a adapt_hold such windows in a row. Each lowering doubles
+ * \a adapt_hold, to not swing the level on the traffic of short messages.
+ * \param u Pointer to the UART structure.
+ * \param timeout Not 0 if this is a timeout interrupt.
+ */
+static void fifo_adapt(sio_uart_t *u, int timeout)
+{
+    u->adapt_irqs++;
+    if (timeout) {
+        u->adapt_rdto++;
+    }
+    if (u->adapt_irqs < ADAPT_WINDOW) {
+        return;
+    }
+
+    if ((u->adapt_rdto * 4) > ADAPT_WINDOW) { // More than 1/4 are timeouts?
+        u->adapt_clean = 0;
+        if (u->itl > fifo_min_itl(u)) {
+            fifo_set_trigger(u, u->itl - 1);
+            if (u->adapt_hold < ADAPT_HOLD_MAX) {
+                u->adapt_hold <<= 1;
             }
         }
-        _enable();
-    }*/
+    } else if (0 == u->adapt_rdto) {
+        if ((++u->adapt_clean >= u->adapt_hold) && (u->itl < 3)) {
+            u->adapt_clean = 0;
+            fifo_set_trigger(u, u->itl + 1);
+        }
+    }
+    u->adapt_irqs = 0;
+    u->adapt_rdto = 0;
+}
 
-    /* Configuring "standard" UART interrupts. */
+/*!
+ * Returns the time of one character, in us.
+ * \param bps Baud rate.
+ * \param bits Number of bits of the character, with the start and the stop bits.
+ */
+static u16 char_time(u32 bps, int bits)
+{
+    if (!bps) {
+        return 0;
+    }
+    u32 us = ((u32)bits * 1000000UL + bps / 2) / bps;
+    return (us > 0xFFFF) ? (0xFFFF) : ((u16)us);
+}
 
-    // Enable Received Data Available Interrupt,
-    // Enable Transmitter Holding Register Empty Interrupt
-    outp(uarts[nport]->addr.ier, SIO_IER_ERDAI | SIO_IER_ETHREI);
+/*!
+ * Computes the idle time which closes a frame of UART \a u, and whether
+ * the timeout interrupt closes the frames (it comes after 4 characters
+ * of the idle line, only from a UART with FIFO).
+ * The time is limited by 0x7FFF us, the half of period of the counter tio_now().
+ * \param u Pointer to the UART structure.
+ */
+static void frame_set_idle(sio_uart_t *u)
+{
+    u32 us = ((u32)u->frame_half_chars * u->char_us) / 2;
+    u->frame_idle = (us > 0x7FFF) ? (0x7FFF) : ((u16)us);
+    u->frame_rdto = (SIO_FCR_EF & u->fcr) && (((u32)u->char_us * 4) >= u->frame_idle);
+    if (u->itl < fifo_min_itl(u)) {
+        fifo_set_trigger(u, fifo_min_itl(u));
+    }
+}
 
-    // COM1 and/or COM4
-    if (((SIO_COM1 == nport) && (!uarts[SIO_COM4]))
-            || ((SIO_COM4 == nport) && (!uarts[SIO_COM1]))) {
+/*!
+ * Computes the nearest divisor of the baud rate \a bps.
+ * The UART 16550 divides its clock by 16 * divisor, the internal UART
+ * of the CPU (COM_PGM) divides the CPU clock by 32 * (divisor + 1), for it
+ * the rates of sio_speed_t by the clock SIO_CLOCK_PGM use the divisors of the vendor.
+ * \param nport Port number as sio_com_t.
+ * \param bps Desired baud rate, not 0.
+ * \param clock_hz Clock of the UART, in Hz.
+ * \param div Pointer to which the value of the divisor register is written.
+ * \return Real baud rate, 0 if the rate is not reachable.
+ */
+static u32 baud_divisor(sio_com_t nport, u32 bps, u32 clock_hz, u16 *div)
+{
+    u32 prescaler = 16; // 16550.
+    u32 offset = 0;
 
-        _disable();
-        outpw(0xFF22, 0x0C); // Reset external interrups from  INT0.
-        outpw(0xFF28, (inpw(0xFF28) | intmasks[nport])); // Disable external interupt.
-        _enable();
+#ifdef COM_PGM
+    if (SIO_COM_PGM == nport) {
+        prescaler = 32;
+        offset = 1;
+        if (SIO_CLOCK_PGM == clock_hz) {
+            for (unsigned int i = 0; i < (sizeof(pgm_divisors) / sizeof(pgm_divisors[0])); ++i) {
+                if (pgm_divisors[i].bps == bps) {
+                    *div = pgm_divisors[i].div;
+                    return (clock_hz / prescaler) / ((u32)pgm_divisors[i].div + offset);
+                }
+            }
+        }
+    }
+#endif
 
-        old_vecs[0] = _dos_getvect(intnums[nport]); // Save old interrupt vector.
-        _dos_setvect(intnums[nport], handler1_4);   // Set new interrupt vector.
+    u32 d = ((clock_hz / prescaler) + (bps / 2)) / bps;
+    if ((!d) || ((d - offset) > 0xFFFFUL)) {
+        return 0;
+    }
+    *div = (u16)(d - offset);
+    return (clock_hz / prescaler) / d;
+}
 
-        _disable();
-        // Interrupt initiated by the lower level to high end,
-        // including a special fully nested mode INT0
-        outpw(0xFF38, (inpw(0xFF38) | 0xCF));
-        outpw(0xFF28, (inpw(0xFF28) & (~intmasks[nport]))); // Enable external interrups from INT0.
-        _enable();
+/*!
+ * Writes the divisor of the baud rate \a bps to the UART of port \a nport
+ * and updates the time of one character. Interrupts must be disabled.
+ * \param nport Port number as sio_com_t.
+ * \param bps Desired baud rate, not 0.
+ * \param clock_hz Clock of the UART, in Hz.
+ * \return -1 if the rate is not reachable.
+ */
+static int baud_write(sio_com_t nport, u32 bps, u32 clock_hz)
+{
+    sio_uart_t *u = uarts[nport];
+    u16 div;
+    u32 real = baud_divisor(nport, bps, clock_hz, &div);
 
-        uarts[nport]->flags |= F_BLOCK_MODE;
+    if (!real) {
+        return -1;
+    }
+
+#ifdef COM_PGM
+    if (SIO_COM_PGM == nport) {
+        outpw(u->addr.mcr, div);
+    } else
+#endif
+    {
+        // 1 = DLLB, DLHB accessible.
+        outp(u->addr.lcr, (inp(u->addr.lcr) | SIO_LCR_DLAB));
+        // Set baud rate.
+        outpw(u->addr.base, div);
+        // 0 = RB accessible.
+        outp(u->addr.lcr, (inp(u->addr.lcr) & (~SIO_LCR_DLAB)));
+    }
+    u->bps = bps;
+    u->bps_real = real;
+    u->char_us = char_time(real, u->char_bits);
+    frame_set_idle(u);
+    return 0;
+}
+
+/*!
+ * Adds the byte \a c to CRC-16 \a crc.
+ */
+#define CRC_ADD(crc, c) ((u16)(((crc) >> 8) ^ crc_table[((crc) ^ (c)) & 0xFF]))
+
+/*!
+ * Adds to the CRC-16 of the frame being received by UART \a u the characters
+ * of the input queue from the index \a start up to the end of the queue.
+ * \param u Pointer to the UART structure.
+ * \param start Index of the first character received by this interrupt.
+ */
+static void frame_crc(sio_uart_t *u, u16 start)
+{
+    u16 crc = u->rx_crc;
+    u16 in = u->rx.in;
+    const unsigned char *data = (const unsigned char *)u->rx.data;
+    if (in < start) { // On the border of the ring buffer?
+        while (start < u->rx.size) {
+            crc = CRC_ADD(crc, data[start++]);
+        }
+        start = 0;
+    }
+    while (start < in) {
+        crc = CRC_ADD(crc, data[start++]);
+    }
+    u->rx_crc = crc;
+}
+
+/*!
+ * Closes the frame being received by UART \a u at the index \a end
+ * of the input queue and stores it to the frame index.
+ * If the frame index is full, the frame remains open and
+ * is merged with the next one.
+ * \param u Pointer to the UART structure.
+ * \param end Index of the cell after the last character of the frame.
+ */
+static void frame_close(sio_uart_t *u, u16 end)
+{
+    int len = end - u->frame_start;
+    if (len < 0) {
+        len += u->rx.size;
+    }
+    if (len) {
+        int next = (u->frame_in + 1) % FRAMES;
+        if (next == u->frame_out) { // Index is full?
+            return;
+        }
+        u->frames[u->frame_in].start = u->frame_start;
+        u->frames[u->frame_in].len = len;
+        u->frames[u->frame_in].crc = u->rx_crc;
+        u->frame_in = next; // Publish the frame.
+        u->frame_ev = 1;
+    }
+    u->frame_open = 0;
+}
+
+/*!
+ * Splits into frames the characters which UART \a u has received by one interrupt,
+ * from the index \a start up to the end of the input queue.
+ *
+ * The characters of one interrupt follow each other, so the time of the first
+ * one is estimated back from the time of the last one. If the idle time before
+ * the first character exceeds \a frame_idle, the previous frame is closed.
+ * \param u Pointer to the UART structure.
+ * \param start Index of the first character received by this interrupt.
+ * \param after Number of characters received after the last one of this interrupt:
+ * 0, 1 if a character is left in the RX FIFO, or 4 for a timeout interrupt
+ * (the line is idle for 4 characters).
+ */
+static void frame_rx(sio_uart_t *u, u16 start, int after)
+{
+    int n = u->rx.in - start;
+    if (n < 0) {
+        n += u->rx.size;
+    }
+
+    u16 last = tio_now() - after * u->char_us;
+
+    if (n > 0) {
+        u16 first = last - (n - 1) * u->char_us;
+        if (u->frame_open && ((s16)(first - u->rx_stamp) >= (s16)u->frame_idle)) {
+            frame_close(u, start);
+        }
+        if (!u->frame_open) {
+            u->frame_open = 1;
+            u->frame_start = start;
+            u->rx_crc = SIO_CRC16_INIT;
+        }
+        if (u->rx_crc_on) {
+            frame_crc(u, start);
+        }
+        u->rx_stamp = last;
+    }
+
+    // After the timeout the line is idle at least 4 characters.
+    if ((4 == after) && u->frame_open && (((u32)u->char_us * 4) >= u->frame_idle)) {
+        frame_close(u, u->rx.in);
+    }
+}
+
+/*!
+ * Reads and discards the echo of the transmitted bytes from the RX FIFO
+ * of the "standard" UART \a u in the RS-485 mode: no more than \a echo bytes,
+ * the bytes after them are the response. If \a all is not 0, the whole FIFO
+ * is discarded, while the driver is enabled nobody else can transmit.
+ * \param u Pointer to the UART structure.
+ * \param all Not 0 to discard also the bytes over \a echo.
+ */
+static void rx_discard(sio_uart_t *u, int all)
+{
+    while ((all || u->echo) && (SIO_LSR_DR & inp(u->addr.lsr))) {
+        inp(u->addr.base);
+        if (u->echo) {
+            u->echo--;
+        }
+        u->stats.rx_echo_bytes++;
+    }
+}
+
+/*!
+ * Releases the RS-485 bus of the "standard" UART \a u, if the transmission is
+ * finished: there is nothing more to transmit, and the echo of all transmitted
+ * bytes is received or the last byte has left the shift register (a transceiver
+ * without the echo). Discards the echo from the RX FIFO and disables the driver
+ * (deasserts RTS). It does not wait: the echo of each byte is an interrupt (the
+ * trigger level is 1, see fifo_write()), the UART has no interrupt when the shift
+ * register gets empty, so it is called again by every next interrupt of the UART,
+ * by the polling, and by the user code through rs485_poll(). Interrupts must be disabled.
+ * \param u Pointer to the UART structure.
+ * \return Not 0 if the bus is released.
+ */
+static int rs485_release(sio_uart_t *u)
+{
+    if ((u->tx.out != u->tx.in) || u->zc_len) {
         return 0;
     }
+    rx_discard(u, 0);
+    if (u->echo) {
+        int lsr = inp(u->addr.lsr);
+        lsr_errors(u, lsr); // LSR clears them on read.
+        if (!(SIO_LSR_EDHR & lsr)) {
+            return 0; // The last byte is being transmitted.
+        }
+        u->echo = 0; // The echo is lost or the transceiver has not it.
+    }
+    outp(u->addr.mcr, inp(u->addr.mcr) & (~SIO_MCR_FRS));
+    u->flags &= ~F_RS485_TX;
+    fifo_write(u); // Restore the trigger level.
+    u->turnaround = tio_now();
+    return 1;
+}
 
-    // COM2
-    if (SIO_COM2 == nport) {
+/*!
+ * Releases the RS-485 bus of port \a nport, if the transmission is finished.
+ * Called by the user code.
+ * \param nport Port number as sio_com_t.
+ */
+static void rs485_poll(sio_com_t nport)
+{
+    if (F_RS485_TX & uarts[nport]->flags) {
         _disable();
-        outpw(0xFF22,0x0E); // Reset external interrups from  INT2.
-        outpw(0xFF28, (inpw(0xFF28) | intmasks[nport])); // Disable external interupt.
+        if (F_RS485_TX & uarts[nport]->flags) {
+            rs485_release(uarts[nport]);
+        }
         _enable();
+    }
+}
 
-        old_vecs[1] = _dos_getvect(intnums[nport]); // Save old interrupt vector.
-        _dos_setvect(intnums[nport],handler2);      // Set new interrupt vector.
+/*!
+ * Closes the frame being received by the UART \a u of port \a nport,
+ * if the line is idle for \a frame_idle. Called by the user code for the
+ * ports where the timeout interrupt does not close the frames (see \a frame_rdto).
+ * \param nport Port number as sio_com_t.
+ */
+static void frame_poll(sio_com_t nport)
+{
+    sio_uart_t *u = uarts[nport];
+    rs485_poll(nport); // The response could follow the request.
+    _disable();
+    if (u->frame_open && ((u16)(tio_now() - u->rx_stamp) >= u->frame_idle)) {
+#ifdef COM_PGM
+        if (SIO_COM_PGM == nport) {
+            frame_close(u, u->rx.in);
+        } else {
+#endif
+            // The characters below the trigger level wait in the RX FIFO
+            // until the timeout interrupt, so the frame is not complete yet.
+            int r = inp(u->addr.lsr);
+            lsr_errors(u, r);
+            if (!(SIO_LSR_DR & r)) {
+                frame_close(u, u->rx.in);
+            }
+#ifdef COM_PGM
+        }
+#endif
+    }
+    _enable();
+}
 
-        _disable();
-        outpw(0xFF28, (inpw(0xFF28) & (~intmasks[nport]))); // Enable external interrups from INT2.
-        _enable();
+/*!
+ * Checks the RX events of port \a nport after the characters have been received
+ * from the index \a start up to the end of the input queue, and notifies them.
+ * \param nport Port number as sio_com_t.
+ * \param start Index of the first character received by this interrupt.
+ */
+static void rx_notify(sio_com_t nport, u16 start)
+{
+    sio_uart_t *u = uarts[nport];
+    int ev = 0;
+
+    int n = u->rx.in - start;
+    if (n < 0) {
+        n += u->rx.size;
+    }
+
+    // The queue has crossed the watermark?
+    if (u->rx_watermark) {
+        int chars = queue_chars(&u->rx);
+        if ((chars >= u->rx_watermark) && ((chars - n) < u->rx_watermark)) {
+            ev |= SIO_EV_WATERMARK;
+        }
+    }
+
+    // The delimiter is received?
+    if (SIO_NO_DELIMITER != u->rx_delimiter) {
+        for (u16 i = start; n > 0; --n) {
+            if (u->rx_delimiter == (u8)u->rx.data[i]) {
+                ev |= SIO_EV_DELIMITER;
+                break;
+            }
+            if (++i == u->rx.size) {
+                i = 0;
+            }
+        }
+    }
+
+    // The frame is closed?
+    if (u->frame_ev) {
+        u->frame_ev = 0;
+        ev |= SIO_EV_FRAME;
+    }
+
+    if (ev) {
+        u->events |= ev;
+        if (u->notify) {
+            u->notify(nport, ev);
+        }
+    }
+}
+
+/*!
+ * Transfers no more than \a max bytes of port \a nport to the "standard" UART.
+ * If a zero-copy transfer is pending, the bytes queued before the transfer
+ * go first, then the bytes of the caller's buffer, then the rest of the queue.
+ * It is used out of the fast loops of the ISR.
+ * \param nport Port number as sio_com_t.
+ * \param max Maximum number of bytes (free space of the TX FIFO).
+ * \return Number of bytes transferred.
+ */
+static int tx_feed(sio_com_t nport, int max)
+{
+    sio_uart_t *u = uarts[nport];
+    int n;
+    for (n = 0; n < max; ++n) {
+        if ((F_TX_ZC & u->flags) && (u->tx.out == u->zc_mark)) {
+            outp(u->addr.base, *u->zc_data++);
+            u->stats.tx_bytes++;
+            if (F_RS485_TX & u->flags) {
+                u->echo++;
+            }
+            if (0 == --u->zc_len) { // End of the transfer.
+                u->flags &= ~F_TX_ZC;
+                if (u->zc_done) {
+                    u->zc_done(nport, u->zc_buf);
+                }
+            }
+        } else if (u->tx.out != u->tx.in) {
+            outp(u->addr.base, u->tx.data[u->tx.out]);
+            u->stats.tx_bytes++;
+            if (F_RS485_TX & u->flags) {
+                u->echo++;
+            }
+            if (F_POW2_BUFFERS & u->flags) {
+                u->tx.out = (u->tx.out + 1) & u->tx.mask;
+            } else if ((u->tx.out + 1) == u->tx.size) {
+                u->tx.out = 0;
+            } else {
+                u->tx.out++;
+            }
+        } else {
+            break;
+        }
+    }
+    return n;
+}
+
+/*!
+ * Interrupt sub-handler a concrete of port \a nport.
+ * Services the UART until its IIR reports no pending interrupt.
+ * \param nport Port number as sio_com_t.
+ * \return Number of the served interrupts.
+ */
+static int com_vce_isr(sio_com_t nport)
+{
+    int r;
+    int n = 0;
+    while (!(SIO_IIR_IP & (r = inp(uarts[nport]->addr.iir_fcr)))) {
+
+        uarts[nport]->stats.irqs++;
+        ++n;
+
+        switch (SIO_IIR_ID_MASK & r) {
+
+        /* Modem Status Interrupt */
+        case SIO_IIR_MSI:
+            r = inp(uarts[nport]->addr.msr); // Clear the interrupt.
+            // CTS is asserted again, resume the transmission.
+            if ((F_CTS_FLOW & uarts[nport]->flags) && (SIO_MSR_CTS & r)
+                    && (SIO_LSR_ETHR & inp(uarts[nport]->addr.lsr))) {
+                tx_feed(nport, uarts[nport]->tx_fifo);
+            }
+            break;
+
+            /* Receiver Line Status Register */
+        case SIO_IIR_RLSI:
+            lsr_errors(uarts[nport], inp(uarts[nport]->addr.lsr)); // Count and clear the errors.
+            break;
+
+            /* Empty Transmitter Holding Register */
+        case SIO_IIR_THREI:
+            // If CTS is deasserted, the transmission is resumed by the Modem Status Interrupt.
+            if ((F_CTS_FLOW & uarts[nport]->flags) && (!(SIO_MSR_CTS & inp(uarts[nport]->addr.msr)))) {
+                break;
+            }
+            if (SIO_LSR_ETHR & inp(uarts[nport]->addr.lsr)) {
+                // Transfer a maximum of the TX FIFO depth.
+                // Use r variable as iterator (for economy).
+                if (F_TX_ZC & uarts[nport]->flags) {
+                    r = tx_feed(nport, uarts[nport]->tx_fifo);
+                } else if (F_POW2_BUFFERS & uarts[nport]->flags) {
+                    for (r = 0; (r < uarts[nport]->tx_fifo) && (uarts[nport]->tx.out != uarts[nport]->tx.in); ++r) {
+                        outp(uarts[nport]->addr.base, uarts[nport]->tx.data[uarts[nport]->tx.out]);
+                        uarts[nport]->tx.out = (uarts[nport]->tx.out + 1) & uarts[nport]->tx.mask;
+                    }
+                    uarts[nport]->stats.tx_bytes += r;
+                    if (F_RS485_TX & uarts[nport]->flags) {
+                        uarts[nport]->echo += r;
+                    }
+                } else {
+                    for (r = 0; (r < uarts[nport]->tx_fifo) && (uarts[nport]->tx.out != uarts[nport]->tx.in); ++r) {
+                        outp(uarts[nport]->addr.base, uarts[nport]->tx.data[uarts[nport]->tx.out]);
+                        if ((uarts[nport]->tx.out + 1) == uarts[nport]->tx.size) {
+                            uarts[nport]->tx.out = 0;
+                        } else {
+                            uarts[nport]->tx.out++;
+                        }
+                    }
+                    uarts[nport]->stats.tx_bytes += r;
+                    if (F_RS485_TX & uarts[nport]->flags) {
+                        uarts[nport]->echo += r;
+                    }
+                }
+                // Nothing more to transmit, release the RS-485 bus if the last byte is out.
+                if ((F_RS485_TX & uarts[nport]->flags) && (0 == r)) {
+                    rs485_release(uarts[nport]);
+                }
+            }
+            break;
+
+            /* Received Data Ready */
+        case SIO_IIR_RDAI:
+            if (F_RS485_TX & uarts[nport]->flags) {
+                // The echo, the last byte could be transmitted. After the release
+                // the rest of the FIFO is the response, it comes by the next interrupt.
+                if (!rs485_release(uarts[nport])) {
+                    rx_discard(uarts[nport], 1);
+                }
+                break;
+            }
+            r = uarts[nport]->rx.in; // Beginning of the received bytes.
+            if ((F_RX_FRAMING & uarts[nport]->flags) && uarts[nport]->frame_rdto) {
+                // Leave the last byte in the FIFO, so the timeout interrupt
+                // comes when the line gets idle and closes the frame.
+                rx_drain(uarts[nport], uarts[nport]->rx_trigger - 1, 0);
+            } else if (F_RX_BURST & uarts[nport]->flags) {
+                // The FIFO holds at least trigger level bytes, so read them
+                // without polling LSR, except the last byte to be read
+                // below with the tail.
+                rx_drain(uarts[nport], uarts[nport]->rx_trigger - 1, 1);
+                uarts[nport]->stats.rx_bursts++;
+                uarts[nport]->stats.rx_burst_bytes += uarts[nport]->rx_trigger - 1;
+            } else {
+                rx_drain(uarts[nport], 0, 1);
+            }
+            uarts[nport]->stats.rx_irqs++;
+            if (F_RTS_FLOW & uarts[nport]->flags) {
+                rx_throttle(uarts[nport]);
+            }
+            if (F_RX_FRAMING & uarts[nport]->flags) {
+                frame_rx(uarts[nport], r, uarts[nport]->frame_rdto);
+            }
+            if (F_RX_NOTIFY & uarts[nport]->flags) {
+                rx_notify(nport, r);
+            }
+            if (F_FIFO_ADAPTIVE & uarts[nport]->flags) {
+                fifo_adapt(uarts[nport], 0);
+            }
+            break;
+
+            /* Receive Data time out */
+        case SIO_IIR_RDTO:
+            if (F_RS485_TX & uarts[nport]->flags) {
+                if (!rs485_release(uarts[nport])) {
+                    rx_discard(uarts[nport], 1);
+                }
+                break;
+            }
+            r = uarts[nport]->rx.in; // Beginning of the received bytes.
+            rx_drain(uarts[nport], 0, 1);
+            uarts[nport]->stats.rx_irqs++;
+            uarts[nport]->stats.rx_timeouts++;
+            if (F_RTS_FLOW & uarts[nport]->flags) {
+                rx_throttle(uarts[nport]);
+            }
+            if (F_RX_FRAMING & uarts[nport]->flags) {
+                frame_rx(uarts[nport], r, 4);
+            }
+            if (F_RX_NOTIFY & uarts[nport]->flags) {
+                rx_notify(nport, r);
+            }
+            if (F_FIFO_ADAPTIVE & uarts[nport]->flags) {
+                fifo_adapt(uarts[nport], 1);
+            }
+            break;
+
+        default:;
+        }//sw
+
+    }//while
+    return n;
+}
+
+/*!
+ * Adds port \a nport to the UARTs \a sh, which share one interrupt line.
+ * Interrupts must be disabled.
+ * \param sh Pointer to the shared UARTs.
+ * \param nport Port number as sio_com_t.
+ */
+static void shared_add(sio_shared_t *sh, sio_com_t nport)
+{
+    if (sh->cnt < SHARED_MAX) {
+        sh->ports[sh->cnt++] = nport;
+    }
+}
+
+/*!
+ * Removes port \a nport from the UARTs \a sh, which share one interrupt line.
+ * Interrupts must be disabled.
+ * \param sh Pointer to the shared UARTs.
+ * \param nport Port number as sio_com_t.
+ */
+static void shared_remove(sio_shared_t *sh, sio_com_t nport)
+{
+    for (int i = 0; i < sh->cnt; ++i) {
+        if (nport == sh->ports[i]) {
+            sh->ports[i] = sh->ports[--sh->cnt];
+            break;
+        }
+    }
+}
+
+/*!
+ * Services the UARTs \a sh, which share one interrupt line.
+ *
+ * The UARTs are served in turn until all of them report no pending
+ * interrupt one after another, so the edge of the interrupt line raised by one
+ * UART while the other one is served is not lost. Each sub-handler ends by
+ * the idle IIR, thus an idle UART costs one read of IIR per interrupt,
+ * and the closed UARTs are not read at all.
+ * \param sh Pointer to the shared UARTs.
+ */
+static void shared_dispatch(sio_shared_t *sh)
+{
+    int i = 0;
+    int idle = 0;
+    while (idle < sh->cnt) {
+        TRACE_START(t);
+        if (com_vce_isr(sh->ports[i])) {
+            TRACE_STOP(uarts[sh->ports[i]], isr, t);
+            idle = 1;
+        } else {
+            ++idle;
+        }
+        if (++i == sh->cnt) {
+            i = 0;
+        }
+    }
+}
+
+/*!
+ * COM1/COM4 interrupt handler.
+ * Works with enabled interrupts as handler2(). INT0 is not in the special
+ * fully nested mode, so it is not re-entered until EOI and the dispatch
+ * loop is not nested; the edge of INT0 raised meanwhile is served after EOI.
+ */
+static void __interrupt handler1_4(void)
+{
+    _enable();
+    shared_dispatch(&int0);
+    // Reset the external interrupt INT0 UART,
+    // where 0x000C - EOI (End Of Interrupt)
+    outpw(0xFF22, 0x000C);
+}
+
+/*!
+ * COM2 interrupt handler.
+ */
+static void __interrupt handler2(void)
+{
+    _enable();
+    if (uarts[SIO_COM2]) {
+        TRACE_START(t);
+        com_vce_isr(SIO_COM2);
+        TRACE_STOP(uarts[SIO_COM2], isr, t);
+    }
+    // Reset the external interrupt INT2 UART,
+    // where 0x000E - EOI (End Of Interrupt)
+    outpw(0xFF22, 0x000E);
+}
+
+#ifdef COM_PGM
+
+/*!
+ * Services the internal UART of the CPU (COM_PGM) by its status register:
+ * transmits the next byte and receives a byte.
+ */
+static void pgm_service(void)
+{
+    int r = inpw(uarts[SIO_COM_PGM]->addr.lsr);
+    if ((0x000F & r) == 0) {
+        //новое
+        //передача
+        if (0x0060 & r) {
+            if (uarts[SIO_COM_PGM]->tx.out == uarts[SIO_COM_PGM]->tx.in) {
+                // Enf of transmission.
+                outpw(uarts[SIO_COM_PGM]->addr.lcr, inpw(uarts[SIO_COM_PGM]->addr.lcr) & 0xF7FF);
+            } else {
+                outp(uarts[SIO_COM_PGM]->addr.iir_fcr, uarts[SIO_COM_PGM]->tx.data[uarts[SIO_COM_PGM]->tx.out]);
+                uarts[SIO_COM_PGM]->stats.tx_bytes++;
+                if (F_POW2_BUFFERS & uarts[SIO_COM_PGM]->flags) {
+                    uarts[SIO_COM_PGM]->tx.out = (uarts[SIO_COM_PGM]->tx.out + 1) & uarts[SIO_COM_PGM]->tx.mask;
+                } else if ((uarts[SIO_COM_PGM]->tx.out + 1) == uarts[SIO_COM_PGM]->tx.size) {
+                    uarts[SIO_COM_PGM]->tx.out = 0;
+                } else {
+                    uarts[SIO_COM_PGM]->tx.out++;
+                }
+            }
+        }
+        // Receive.
+        if (0x0010 & r) {
+            u16 start = uarts[SIO_COM_PGM]->rx.in; // Beginning of the received bytes.
+            r = inpw(uarts[SIO_COM_PGM]->addr.base);
+            if (F_RX_LARGE & uarts[SIO_COM_PGM]->flags) {
+                rx_put_large(uarts[SIO_COM_PGM], r);
+            } else if (F_POW2_BUFFERS & uarts[SIO_COM_PGM]->flags) {
+                rx_put_pow2(uarts[SIO_COM_PGM], r);
+            } else {
+                rx_put(uarts[SIO_COM_PGM], r);
+            }
+            uarts[SIO_COM_PGM]->stats.rx_irqs++;
+            uarts[SIO_COM_PGM]->stats.rx_polled_bytes++;
+            rx_update_peak(uarts[SIO_COM_PGM]);
+            if (F_RX_FRAMING & uarts[SIO_COM_PGM]->flags) {
+                frame_rx(uarts[SIO_COM_PGM], start, 0);
+            }
+            if (F_RX_NOTIFY & uarts[SIO_COM_PGM]->flags) {
+                rx_notify(SIO_COM_PGM, start);
+            }
+        }
+    } else {
+        //If have errors then reset it.
+        uarts[SIO_COM_PGM]->stats.rx_line_errors++;
+        outpw(uarts[SIO_COM_PGM]->addr.lsr, 0x00F0 & r);
+    }
+}
+
+/*!
+ * PGM interrupt handler.
+ */
+static void __interrupt handler_pgm(void)
+{
+    _enable();
+    uarts[SIO_COM_PGM]->stats.irqs++;
+    TRACE_START(t);
+    pgm_service();
+    TRACE_STOP(uarts[SIO_COM_PGM], isr, t);
+    // Reset interrupt from the internal UART CPU,
+    // where 0x0014 - EOI (End Of Interrupt)
+    outpw(0xFF22, 0x0014);
+}
+
+#endif //COM_PGM
+
+/*!
+ * Services the "standard" UART of port \a nport opened in the mode
+ * SIO_POLLED: its interrupts are disabled, so the state is read from LSR.
+ * Interrupts must be disabled.
+ * \param nport Port number as sio_com_t.
+ * \return Not 0 if the UART had a work.
+ */
+static int com_poll(sio_com_t nport)
+{
+    sio_uart_t *u = uarts[nport];
+    int n = 0;
+    int lsr = inp(u->addr.lsr);
+    lsr_errors(u, lsr); // LSR clears them on read.
+    // CTS instead of the Modem Status Interrupt, MSR clears the deltas on read.
+    int msr = (F_CTS_FLOW & u->flags) ? ((int)inp(u->addr.msr)) : ((int)SIO_MSR_CTS);
+
+    // Receive.
+    if (SIO_LSR_DR & lsr) {
+        if (F_RS485_TX & u->flags) {
+            // The response is read by the next poll.
+            if (!rs485_release(u)) {
+                rx_discard(u, 1);
+            }
+        } else {
+            u16 start = u->rx.in; // Beginning of the received bytes.
+            rx_drain(u, 0, 1);
+            if (F_RTS_FLOW & u->flags) {
+                rx_throttle(u);
+            }
+            if (F_RX_FRAMING & u->flags) {
+                frame_rx(u, start, 0);
+            }
+            if (F_RX_NOTIFY & u->flags) {
+                rx_notify(nport, start);
+            }
+        }
+        ++n;
+    }
+
+    // Transmit.
+    if ((SIO_LSR_ETHR & lsr) && (SIO_MSR_CTS & msr)) {
+        if (tx_feed(nport, u->tx_fifo)) {
+            ++n;
+        } else if (F_RS485_TX & u->flags) {
+            // Nothing more to transmit, release the RS-485 bus if the last byte is out.
+            rs485_release(u);
+        }
+    }
+    return n;
+}
+
+/*!
+ * Services port \a nport opened in the mode SIO_POLLED.
+ * \param nport Port number as sio_com_t.
+ * \return Not 0 if the UART had a work.
+ */
+static int port_poll(sio_com_t nport)
+{
+    int n;
+    _disable();
+    TRACE_START(t);
+#ifdef COM_PGM
+    if (SIO_COM_PGM == nport) {
+        u32 bytes = uarts[SIO_COM_PGM]->stats.rx_bytes + uarts[SIO_COM_PGM]->stats.tx_bytes;
+        pgm_service();
+        n = (bytes != (uarts[SIO_COM_PGM]->stats.rx_bytes + uarts[SIO_COM_PGM]->stats.tx_bytes));
+    } else
+#endif
+    {
+        n = com_poll(nport);
+    }
+    if (n) {
+        uarts[nport]->stats.polls++;
+    }
+    TRACE_STOP(uarts[nport], masked, t);
+    _enable();
+    return n;
+}
+
+/*!
+ * Copies byte array \a buf of length \a len to the output queue of port \a nport
+ * at the index \a in, without publishing it for the ISR.
+ * \param nport Port number as sio_com_t.
+ * \param in Index of where to store the bytes.
+ * \param buf A pointer to an array of bytes.
+ * \param len Number of bytes to copy, no more than queue_free().
+ * \return Index of the cell after the copied bytes.
+ */
+static u16 tx_copy(sio_com_t nport, u16 in, const char *buf, int len)
+{
+    // How many to copy to the ring buffer?
+    // It is on the border of the ring buffer?
+    int sizecpy = ((in + len) <= uarts[nport]->tx.size) ?
+                (len) : (uarts[nport]->tx.size - in);
+
+    // Copy to the boundary of the ring buffer
+    memcpy(uarts[nport]->tx.data + in, buf, sizecpy);
+
+    if (sizecpy < len) { // This is not all?
+        sizecpy = len - sizecpy; // Compute the remainder.
+        in = 0; // Beginning of the buffer.
+        // Copy the remainder to the beginning of the ring buffer.
+        memcpy(uarts[nport]->tx.data, buf + (len - sizecpy), sizecpy);
+    }
+
+    in += sizecpy; // A pointer to an next empty cell, the ring buffer.
+
+    // A pointer to an empty cell, the ring buffer outside the buffer size?
+    if (F_POW2_BUFFERS & uarts[nport]->flags) {
+        in &= uarts[nport]->tx.mask;
+    } else if (in >= uarts[nport]->tx.size) {
+        in = 0;
+    }
+    return in;
+}
+
+/*!
+ * Same as tx_copy(), and adds the copied bytes to CRC-16 \a crc.
+ * \param nport Port number as sio_com_t.
+ * \param in Index of where to store the bytes.
+ * \param buf A pointer to an array of bytes.
+ * \param len Number of bytes to copy, no more than queue_free().
+ * \param crc Pointer to CRC-16.
+ * \return Index of the cell after the copied bytes.
+ */
+static u16 tx_copy_crc(sio_com_t nport, u16 in, const char *buf, int len, u16 *crc)
+{
+    u16 c = *crc;
+    char *data = uarts[nport]->tx.data;
+    u16 size = uarts[nport]->tx.size;
+    while (len--) {
+        c = CRC_ADD(c, (unsigned char)*buf);
+        data[in] = *buf++;
+        if (++in >= size) {
+            in = 0;
+        }
+    }
+    *crc = c;
+    return in;
+}
+
+/*!
+ * Updates the peak number of bytes in the output queue of UART \a u.
+ * \param u Pointer to the UART structure.
+ */
+static void tx_update_peak(sio_uart_t *u)
+{
+    u16 chars = queue_chars(&u->tx);
+    if (chars > u->stats.tx_peak) {
+        u->stats.tx_peak = chars;
+    }
+}
+
+/*!
+ * Starts the transmission of the output queue of port \a nport,
+ * if the transmitter is idle.
+ * \param nport Port number as sio_com_t.
+ */
+static void tx_kick(sio_com_t nport)
+{
+    // Start interrupt for transfer.
+    // Here the output index belonging to the ISR is changed,
+    // so interrupts are disabled only for this short section.
+    _disable();
+    TRACE_START(t);
+#ifdef COM_PGM // PGM transfer.
+    if (SIO_COM_PGM == nport) {
+        if (!(inpw(uarts[SIO_COM_PGM]->addr.lcr) & 0x0800)) {
+            outpw(uarts[SIO_COM_PGM]->addr.lcr, inpw(uarts[SIO_COM_PGM]->addr.lcr) | 0x0800);
+        }
+    } else {
+#endif
+        if ((inp(uarts[nport]->addr.lsr) & 0x20) // No transmission?
+                && ((!(F_CTS_FLOW & uarts[nport]->flags)) || (SIO_MSR_CTS & inp(uarts[nport]->addr.msr)))) {
+            // Enable the RS-485 driver before the first byte.
+            if ((F_RS485 & uarts[nport]->flags) && (!(F_RS485_TX & uarts[nport]->flags))
+                    && ((uarts[nport]->tx.out != uarts[nport]->tx.in) || uarts[nport]->zc_len)) {
+                outp(uarts[nport]->addr.mcr, inp(uarts[nport]->addr.mcr) | SIO_MCR_FRS);
+                uarts[nport]->flags |= F_RS485_TX;
+                fifo_write(uarts[nport]); // The trigger level 1 for the echo.
+            }
+            // The TX FIFO is empty, fill it at once.
+            tx_feed(nport, uarts[nport]->tx_fifo);
+        }
+#ifdef COM_PGM
+    }
+#endif
+    TRACE_STOP(uarts[nport], masked, t);
+    _enable();
+}
+
+/*!
+ * Copies to the output queue of port \a nport as many bytes of array \a buf
+ * of length \a len as it fits, and starts the transmission.
+ * \param nport Port number as sio_com_t.
+ * \param buf A pointer to an array of bytes.
+ * \param len Number of bytes to transfer.
+ * \return Number of bytes copied to the queue.
+ */
+static int tx_put(sio_com_t nport, const char *buf, int len)
+{
+    // The queue can only get more free space while we copy,
+    // so the copy is done without disabling interrupts.
+    int bytes_to_write = queue_free(&uarts[nport]->tx);
+    if (bytes_to_write > len) {
+        bytes_to_write = len;
+    }
+
+    if (bytes_to_write) {
+        // Publish the data for the ISR.
+        uarts[nport]->tx.in = tx_copy(nport, uarts[nport]->tx.in, buf, bytes_to_write);
+        tx_update_peak(uarts[nport]);
+        tx_kick(nport);
+    }
+    return bytes_to_write;
+}
+
+/*!
+ * Frees the structure and the buffers of port \a nport,
+ * if they are not the storage of the caller.
+ * \param nport Port number as sio_com_t.
+ */
+static void port_free(sio_com_t nport)
+{
+    if (!(F_STATIC & uarts[nport]->flags)) {
+        free(uarts[nport]->tx.data);
+        free(uarts[nport]->rx.data);
+        free(uarts[nport]);
+    }
+    uarts[nport] = 0;
+}
+
+/*!
+ * Opens port \a nport, which structure and buffers are ready.
+ * \param nport Port number as sio_com_t.
+ * \param mode Open mode as sio_mode_t.
+ * \return -1 on error, the structure and the buffers are freed.
+ */
+static int port_open(sio_com_t nport, sio_mode_t mode)
+{
+    uarts[nport]->rx.mask = uarts[nport]->rx.size - 1;
+    uarts[nport]->tx.mask = uarts[nport]->tx.size - 1;
+
+    sioerrno = SIO_ERR_NONE;
+
+    // Set open mode.
+    if (!(SIO_UNBLOCK_MODE & mode)) {
+        uarts[nport]->flags |= F_BLOCK_MODE;
+    }
+    if (SIO_POW2_BUFFERS & mode) {
+        uarts[nport]->flags |= F_POW2_BUFFERS;
+    }
+    if (SIO_RX_BURST & mode) {
+        uarts[nport]->flags |= F_RX_BURST;
+    }
+    if (SIO_POLLED & mode) {
+        uarts[nport]->flags |= F_POLLED;
+    }
+#ifdef SIO_TRACE
+    tio_init(0); // The counter of the times.
+#endif
+
+#ifdef COM_PGM // PGM configure.
+
+    if (SIO_COM_PGM == nport) {
+        // Addresses of RX and TX registers.
+        uarts[SIO_COM_PGM]->addr.base = 0xFF86;    // Receive Register.
+        uarts[SIO_COM_PGM]->addr.iir_fcr = 0xFF84; // Transmit Register.
+        // Addresses of control regisrets.
+        uarts[SIO_COM_PGM]->addr.ier = 0xFF44; // Interrupt Control Register.
+        uarts[SIO_COM_PGM]->addr.lcr = 0xFF80; // Control Register.
+        uarts[SIO_COM_PGM]->addr.lsr = 0xFF82; // Status Register.
+        uarts[SIO_COM_PGM]->addr.mcr = 0xFF88; // Baud Rate Divisor Register.
+        uarts[SIO_COM_PGM]->type = SIO_UART_PGM;
+        uarts[SIO_COM_PGM]->tx_fifo = 1;
+        uarts[SIO_COM_PGM]->levels = trigger_levels_none;
+        uarts[SIO_COM_PGM]->rx_trigger = 1;
+        _disable();
+        // Save old registers state.
+        old_ier = inpw(uarts[SIO_COM_PGM]->addr.ier);
+        old_lcr = inpw(uarts[SIO_COM_PGM]->addr.lcr);
+        old_brd = inpw(uarts[SIO_COM_PGM]->addr.mcr); // Old baud rate.
+        // Interrupts.
+        outpw(0xFF28, (inpw(0xFF28) | intmasks[SIO_COM_PGM])); // Disable UART interrupts.
+        _enable();
+        if (SIO_POLLED & mode) {
+            // The interrupt remains disabled, the vector is not used.
+            outpw(uarts[SIO_COM_PGM]->addr.lcr, 0x0417); // RXIE, WLGN, TMOD, RSIE, RMODE.
+            return 0;
+        }
+        old_vec_pgm = _dos_getvect(intnums[SIO_COM_PGM]); // Save old interrupt vector.
+        _dos_setvect(intnums[SIO_COM_PGM], handler_pgm);  // Set new interrupt vector.
+        // Configuring.
+        outpw(uarts[SIO_COM_PGM]->addr.lcr, 0x0417); // RXIE, WLGN, TMOD, RSIE, RMODE.
+        outpw(0xFF22, 0x0014);// Reset UART interrupts.
+        outpw(uarts[SIO_COM_PGM]->addr.ier, 0x0017);// Interrupt enable
+        outpw(0xFF28, inpw(0xFF28) & (~intmasks[SIO_COM_PGM]));// Enable UART interrupts.
+        return 0;
+    }
+
+#endif
+
+    // "Standard" UART configure.
+    uarts[nport]->addr.base = bases[nport];
+    uarts[nport]->addr.ier = bases[nport] + SIO_OFFSET_IER;
+    uarts[nport]->addr.iir_fcr = bases[nport] + SIO_OFFSET_IIR;
+    uarts[nport]->addr.lcr = bases[nport] + SIO_OFFSET_LCR;
+    uarts[nport]->addr.mcr = bases[nport] + SIO_OFFSET_MCR;
+    uarts[nport]->addr.lsr = bases[nport] + SIO_OFFSET_LSR;
+    uarts[nport]->addr.msr = bases[nport] + SIO_OFFSET_MSR;
+
+    outp(uarts[nport]->addr.ier, 0x00);// Disable interrupt.
+    // Check UART exists.
+    if (inp(uarts[nport]->addr.ier)) {
+        port_free(nport);
+        sioerrno = SIO_ERR_NO_UART;
+        return -1;
+    }
+
+    // Detect UART type, 8250 is not supported.
+    uarts[nport]->type = uart_detect(uarts[nport]);
+    if (SIO_UART_8250 == uarts[nport]->type) {
+        port_free(nport);
+        sioerrno = SIO_ERR_UART_NOT_SUPPORTED;
+        return -1;
+    }
+
+    // Configure FIFO.
+    fifo_init(uarts[nport]);
+
+    // FIXME: Finish in the future.
+    /*if (var_2 == 1)
+    {
+        _disable();
+        if ((inp(0x0178) & 0x80)==0)
+        {
+            if (inp( uarts[nport]->addr.lcr) != 0xBF)
+            {
+                outp(var_e, 0x00);
+                outp(var_10, 0x18);
+            }
+        }
+        _enable();
+    }*/
+
+    /* Configuring "standard" UART interrupts. */
+
+    // Enable Received Data Available Interrupt,
+    // The interrupts of UART remain disabled, the interrupt line is free.
+    if (SIO_POLLED & mode) {
+        return 0;
+    }
+
+    // Enable Transmitter Holding Register Empty Interrupt,
+    // Enable Receiver Line Status Interrupt (for the statistics).
+    outp(uarts[nport]->addr.ier, SIO_IER_ERDAI | SIO_IER_ETHREI | SIO_IER_ELSI);
+
+    // COM1 and/or COM4
+    if ((SIO_COM1 == nport) || (SIO_COM4 == nport)) {
+        _disable();
+        shared_add(&int0, nport);
+        _enable();
+    }
+    if (((SIO_COM1 == nport) || (SIO_COM4 == nport)) && (1 == int0.cnt)) { // The first UART on INT0?
+
+        _disable();
+        outpw(0xFF22, 0x0C); // Reset external interrups from  INT0.
+        outpw(0xFF28, (inpw(0xFF28) | intmasks[nport])); // Disable external interupt.
+        _enable();
+
+        old_vecs[0] = _dos_getvect(intnums[nport]); // Save old interrupt vector.
+        _dos_setvect(intnums[nport], handler1_4);   // Set new interrupt vector.
+
+        _disable();
+        // Interrupt initiated by the lower level to high end,
+        // without the special fully nested mode INT0 (no re-entry of handler1_4()).
+        outpw(0xFF38, ((inpw(0xFF38) | 0x8F) & (~0x40)));
+        outpw(0xFF28, (inpw(0xFF28) & (~intmasks[nport]))); // Enable external interrups from INT0.
+        _enable();
+
+        uarts[nport]->flags |= F_BLOCK_MODE;
+        return 0;
+    }
+
+    // COM2
+    if (SIO_COM2 == nport) {
+        _disable();
+        outpw(0xFF22,0x0E); // Reset external interrups from  INT2.
+        outpw(0xFF28, (inpw(0xFF28) | intmasks[nport])); // Disable external interupt.
+        _enable();
+
+        old_vecs[1] = _dos_getvect(intnums[nport]); // Save old interrupt vector.
+        _dos_setvect(intnums[nport],handler2);      // Set new interrupt vector.
+
+        _disable();
+        outpw(0xFF28, (inpw(0xFF28) & (~intmasks[nport]))); // Enable external interrups from INT2.
+        _enable();
+    }
+    return 0;
+}
+
+//--------------------------------------------------------------------------------------------------------//
+/*** Public functions ***/
+
+/*!
+ * Opens port \a nport with the desired \a mode.
+ * In the process of opening create internal an input and an
+ * output buffer of the specified size \a tx_buf_size and \a rx_buf_size.
+ * \param nport Port number as sio_com_t.
+ * \param mode Open mode as sio_mode_t.
+ * \param tx_buf_size Size of the output buffer of port, in bytes.
+ * \param rx_buf_size Size of the input buffer of port, in bytes.
+ * \return -1 on error.
+ */
+int sio_open(sio_com_t nport, sio_mode_t mode, int tx_buf_size, int rx_buf_size)
+{
+    if (uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_ALREADY_OPEN;
+        return -1;
+    }
+
+    // One extra cell of each ring buffer always remains empty.
+    if ((tx_buf_size <= 0) || (tx_buf_size >= 0x7FFF)
+            || (rx_buf_size <= 0) || (rx_buf_size >= 0x7FFF)) {
+        sioerrno = SIO_ERR_INVALID_BUFFER_SIZE;
+        return -1;
+    }
+    ++tx_buf_size;
+    ++rx_buf_size;
+
+    if (SIO_POW2_BUFFERS & mode) {
+        if ((tx_buf_size > 0x4000) || (rx_buf_size > 0x4000)) {
+            sioerrno = SIO_ERR_INVALID_BUFFER_SIZE;
+            return -1;
+        }
+        tx_buf_size = round_pow2(tx_buf_size);
+        rx_buf_size = round_pow2(rx_buf_size);
+    }
+
+    // Create internel port structure.
+    uarts[nport] = (sio_uart_t *)calloc(1, sizeof(sio_uart_t));
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_NOT_MEMORY;
+        return -1;
+    }
+
+    // Create output port buffer.
+    uarts[nport]->tx.data = (char *)calloc(1, tx_buf_size);
+    if (uarts[nport]->tx.data) {
+        // Create input port buffer.
+        uarts[nport]->rx.data = (char *)calloc(1, rx_buf_size);
+        if (!uarts[nport]->rx.data) {
+            free(uarts[nport]->tx.data);
+            uarts[nport]->tx.data = 0;
+        }
+    }
+
+    // Check existing a input and output buffers.
+    if (!(uarts[nport]->tx.data)) {
+        free(uarts[nport]);
+        uarts[nport] = 0;
+        sioerrno = SIO_ERR_NOT_MEMORY;
+        return -1;
+    }
+
+    // Save buffers size.
+    uarts[nport]->rx.size = rx_buf_size;
+    uarts[nport]->tx.size = tx_buf_size;
+    return port_open(nport, mode);
+}
+
+/*!
+ * Opens port \a nport with the desired \a mode, with the structure and
+ * the buffers of the caller (the heap is not used).
+ * The storage must stay valid until sio_close(), which does not free it.
+ * One cell of each buffer always remains empty. With the option
+ * SIO_POW2_BUFFERS the sizes of the buffers must be a power of two.
+ * \param nport Port number as sio_com_t.
+ * \param mode Open mode as sio_mode_t.
+ * \param storage Pointer to the storage of the port structure.
+ * \param tx Pointer to the output buffer of port.
+ * \param txsz Size of the output buffer of port, in bytes.
+ * \param rx Pointer to the input buffer of port.
+ * \param rxsz Size of the input buffer of port, in bytes.
+ * \return -1 on error.
+ */
+int sio_open_static(sio_com_t nport, sio_mode_t mode, sio_port_storage_t *storage,
+                    char *tx, u16 txsz, char *rx, u16 rxsz)
+{
+    if (uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_ALREADY_OPEN;
+        return -1;
+    }
+
+    if ((!storage) || (!tx) || (!rx)) {
+        sioerrno = SIO_ERR_NOT_MEMORY;
+        return -1;
+    }
+
+    if ((txsz < 2) || (txsz > 0x7FFF) || (rxsz < 2) || (rxsz > 0x7FFF)
+            || ((SIO_POW2_BUFFERS & mode) && ((txsz & (txsz - 1)) || (rxsz & (rxsz - 1))))) {
+        sioerrno = SIO_ERR_INVALID_BUFFER_SIZE;
+        return -1;
+    }
+
+    memset(storage, 0, sizeof(sio_port_storage_t));
+    uarts[nport] = (sio_uart_t *)storage;
+    uarts[nport]->flags = F_STATIC;
+    uarts[nport]->tx.data = tx;
+    uarts[nport]->rx.data = rx;
+    uarts[nport]->rx.size = rxsz;
+    uarts[nport]->tx.size = txsz;
+    return port_open(nport, mode);
+}
+
+/*!
+ * Configures an open port \a nport, and sets desired
+ * rate \a baud, parity \a parity, number of data bits \a databits,
+ * number of stop bits \a stopbits.
+ * \param nport Port number as sio_com_t.
+ * \param baud Desired rate as sio_speed_t.
+ * \param parity Desired parity as sio_parity_t.
+ * \param databits Desired data bits as sio_databits_t.
+ * \param stopbits Desired stop bits as sio_stopbits_t.
+ * \return -1 on error (also if \a baud is out of SIO_BPS_115200 - SIO_BPS_50).
+ */
+int sio_configure(sio_com_t nport, sio_speed_t baud, sio_parity_t parity, sio_databits_t databits, sio_stopbits_t stopbits)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
+    }
+
+    sioerrno = SIO_ERR_ILLEGAL_SETTING; // Forse error set.
+
+    if ((baud < SIO_BPS_115200) || (baud > SIO_BPS_50)) {
+        return -1;
+    }
+
+    int res;
+
+#ifdef COM_PGM // PGM configure.
+
+    if (SIO_COM_PGM == nport) {
+        int r = inpw(uarts[SIO_COM_PGM]->addr.lcr) & 0xFF87; // Clear bits.
+        switch (parity) {
+        case SIO_PAR_NONE: break;
+        case SIO_PAR_EVEN: r |= 0x0060; break;
+        case SIO_PAR_ODD: r |= 0x0040; break;
+        default: return -1;
+        }
+
+        switch (databits) {
+        case SIO_DATA7: break;
+        case SIO_DATA8: r |= 0x0010; break;
+        default: return -1;
+        }
+
+        switch (stopbits) {
+        case SIO_STOP1: break;
+        case SIO_STOP2: r |= 0x0008; break;
+        default:;
+        }
+
+        _disable();
+        outpw (uarts[SIO_COM_PGM]->addr.lcr, r); // Set new parameters.
+
+        // Start, data, parity and stop bits.
+        uarts[SIO_COM_PGM]->char_bits = 2 + (databits + 5) + ((SIO_PAR_NONE != parity) ? 1 : 0)
+                                        + ((SIO_STOP2 == stopbits) ? 1 : 0);
+        // The divisor of the vendor for the CPU clock.
+        res = baud_write(SIO_COM_PGM, SIO_BAUD_BASE / baud, SIO_CLOCK_PGM);
+        _enable();
+
+        if (-1 == res) {
+            return -1;
+        }
+        sioerrno = SIO_ERR_NONE;
+        return 0;
+    }
+
+#endif
+
+    // Configure "standard" UART.
+    _disable();
+    // Set other's parameters.
+    outp(uarts[nport]->addr.lcr, (parity | databits | stopbits));
+
+    // Start, data, parity and stop bits.
+    uarts[nport]->char_bits = 2 + (databits + 5) + ((SIO_PAR_NONE != parity) ? 1 : 0)
+                              + ((SIO_STOP2 == stopbits) ? 1 : 0);
+    // Set baud rate.
+    res = baud_write(nport, SIO_BAUD_BASE / baud, SIO_CLOCK_UART);
+    _enable();
+
+    if (-1 == res) {
+        return -1;
+    }
+    sioerrno = SIO_ERR_NONE;
+    return 0;
+}
+
+/*!
+ * Sets the arbitrary baud rate \a bps of port \a nport.
+ *
+ * The nearest divisor of the clock \a clock_hz is used (for COM_PGM with
+ * the default clock the rates of sio_speed_t use the divisors of the vendor), the real rate
+ * and its error are read by sio_get_baud(). The rates over 115200 baud
+ * (230400, 460800) are reachable by the UART 16550 only with the faster
+ * crystal (3.6864 MHz, 7.3728 MHz). The internal UART of the CPU (COM_PGM)
+ * reaches 250000 baud at most, with the divisor by 32 of the CPU clock.
+ * \note The function must be called after sio_configure(), which sets
+ * the rate of sio_speed_t by the default clock.
+ * \param nport Port number as sio_com_t.
+ * \param bps Desired baud rate.
+ * \param clock_hz Clock of the UART, in Hz, or 0 for the default clock
+ * (SIO_CLOCK_UART or SIO_CLOCK_PGM).
+ * \return -1 on error (also if the error of the rate exceeds SIO_BAUD_TOLERANCE).
+ */
+int sio_set_baud(sio_com_t nport, u32 bps, u32 clock_hz)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
+    }
+
+    if (!clock_hz) {
+        clock_hz = SIO_CLOCK_UART;
+#ifdef COM_PGM
+        if (SIO_COM_PGM == nport) {
+            clock_hz = SIO_CLOCK_PGM;
+        }
+#endif
+    }
+
+    u16 div;
+    u32 real = (bps) ? (baud_divisor(nport, bps, clock_hz, &div)) : (0);
+    // Error in 0.1%.
+    if ((!real) || ((((real > bps) ? (real - bps) : (bps - real)) * 1000UL) / bps > SIO_BAUD_TOLERANCE)) {
+        sioerrno = SIO_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
+
+    _disable();
+    baud_write(nport, bps, clock_hz);
+    _enable();
+
+    sioerrno = SIO_ERR_NONE;
+    return 0;
+}
+
+/*!
+ * Reads the baud rate of port \a nport.
+ * \param nport Port number as sio_com_t.
+ * \param error Pointer to which the error of the real rate relative to
+ * the desired rate is written, in 0.1% (can be 0).
+ * \return Real baud rate, 0 on error.
+ */
+u32 sio_get_baud(sio_com_t nport, int *error)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return 0;
+    }
+
+    if (error) {
+        *error = 0;
+        if (uarts[nport]->bps) {
+            long diff = (long)uarts[nport]->bps_real - (long)uarts[nport]->bps;
+            *error = (int)((diff * 1000L) / (long)uarts[nport]->bps);
+        }
+    }
+    sioerrno = SIO_ERR_NONE;
+    return uarts[nport]->bps_real;
+}
+
+/*!
+ * Sets the flow control of port \a nport.
+ *
+ * In the mode SIO_FLOW_RTSCTS the UARTs 16750 (SIO_MCR_ACE) and 16C950 (EFR)
+ * use their automatic flow control: they deassert RTS by the RX FIFO trigger
+ * level and stop the transmitter while CTS is deasserted. For other UARTs the flow control is
+ * done by the driver: the ISR deasserts RTS when the input queue is filled
+ * by 3/4, the receive functions assert it again when the queue is emptied
+ * to 1/4, and the transmission is stopped while CTS is deasserted and is
+ * resumed by the Modem Status Interrupt (in the mode SIO_POLLED by the polling,
+ * the interrupts of the UART remain disabled).
+ * \note The port COM_PGM is not supported.
+ * \param nport Port number as sio_com_t.
+ * \param flow Desired flow control as sio_flow_t.
+ * \return -1 on error, 1 if the automatic flow control of the UART is used, else 0.
+ */
+int sio_set_flow_control(sio_com_t nport, sio_flow_t flow)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
+    }
+
+#ifdef COM_PGM
+    if (SIO_COM_PGM == nport) {
+        sioerrno = SIO_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
+#endif
+
+    // In the RS-485 mode RTS enables the driver. The flow control by the driver
+    // is not supported with the large input queue.
+    if (((SIO_FLOW_NONE != flow) && (SIO_FLOW_RTSCTS != flow))
+            || ((SIO_FLOW_RTSCTS == flow) && (F_RS485 & uarts[nport]->flags))
+            || ((SIO_FLOW_RTSCTS == flow) && (F_RX_LARGE & uarts[nport]->flags)
+                && (SIO_UART_16750 != uarts[nport]->type) && (SIO_UART_16C950 != uarts[nport]->type))) {
+        sioerrno = SIO_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
+
+    // The RS-485 mode has no flow control, and RTS must remain as it is.
+    if (F_RS485 & uarts[nport]->flags) {
+        sioerrno = SIO_ERR_NONE;
+        return 0;
+    }
+
+    int is_auto = 0;
+    int capacity = uarts[nport]->rx.size - 1;
+
+    _disable();
+    uarts[nport]->flags &= ~(F_RTS_FLOW | F_CTS_FLOW | F_RTS_OFF);
+    // RTS asserted, the automatic flow control is disabled.
+    outp(uarts[nport]->addr.mcr, (inp(uarts[nport]->addr.mcr) | SIO_MCR_FRS) & (~SIO_MCR_ACE));
+    if (!(F_POLLED & uarts[nport]->flags)) {
+        outp(uarts[nport]->addr.ier, inp(uarts[nport]->addr.ier) & (~SIO_IER_EMSI));
+    }
+    if (SIO_UART_16C950 == uarts[nport]->type) {
+        efr_write(uarts[nport], 0x00);
+    }
+
+    if (SIO_FLOW_RTSCTS == flow) {
+        if (SIO_UART_16750 == uarts[nport]->type) {
+            outp(uarts[nport]->addr.mcr, inp(uarts[nport]->addr.mcr) | SIO_MCR_ACE);
+            is_auto = 1;
+        } else if (SIO_UART_16C950 == uarts[nport]->type) {
+            efr_write(uarts[nport], SIO_EFR_ARTS | SIO_EFR_ACTS);
+            is_auto = 1;
+        } else {
+            uarts[nport]->rts_high = capacity - (capacity / 4);
+            uarts[nport]->rts_low = capacity / 4;
+            uarts[nport]->flags |= (F_RTS_FLOW | F_CTS_FLOW);
+            inp(uarts[nport]->addr.msr); // Clear the deltas.
+            // In the mode SIO_POLLED the interrupt line is left free, CTS is read by the polling.
+            if (!(F_POLLED & uarts[nport]->flags)) {
+                outp(uarts[nport]->addr.ier, inp(uarts[nport]->addr.ier) | SIO_IER_EMSI);
+            }
+        }
+    }
+    uarts[nport]->hw_flow = is_auto;
+    _enable();
+
+    // The transmission could be stopped by CTS.
+    tx_kick(nport);
+
+    sioerrno = SIO_ERR_NONE;
+    return is_auto;
+}
+
+/*!
+ * Enables or disables the RS-485 half-duplex mode of port \a nport.
+ *
+ * In this mode the driver of the line is enabled by RTS (the bit SIO_MCR_FRS)
+ * before the first byte is transmitted, and is disabled when the last byte has left
+ * the shift register (SIO_LSR_EDHR). The UART has no interrupt for it, so it is
+ * checked by the next interrupt of the UART, by the polling, and by the functions
+ * of the port (sio_tx_pending(), sio_rx_frames(), etc.). While the driver is
+ * enabled the RX FIFO trigger level is 1, so the echo of each byte raises the
+ * interrupt, and the echo of the last byte releases the bus within one character
+ * after the end of the transmission. The echo is discarded, exactly as many bytes
+ * as transmitted, and counted in \a rx_echo_bytes of the statistics; the bytes
+ * after it are the response and are received. A transceiver without the echo
+ * releases the bus only by the next interrupt or the polling. The moment of
+ * the release is returned by sio_get_turnaround().
+ * \note Only COM2 and COM4 are supported. The mode excludes the RTS/CTS flow control.
+ * \param nport Port number as sio_com_t.
+ * \param enable Not 0 to enable.
+ * \return -1 on error.
+ */
+int sio_set_rs485(sio_com_t nport, int enable)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
+    }
+
+    if (((SIO_COM2 != nport) && (SIO_COM4 != nport))
+            || ((F_RTS_FLOW | F_CTS_FLOW) & uarts[nport]->flags) || uarts[nport]->hw_flow) {
+        sioerrno = SIO_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
+
+    if (enable && (-1 == tio_init(0))) {
+        sioerrno = SIO_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
+
+    _disable();
+    // Driver disabled, receive.
+    outp(uarts[nport]->addr.mcr, inp(uarts[nport]->addr.mcr) & (~SIO_MCR_FRS));
+    uarts[nport]->flags &= ~(F_RS485 | F_RS485_TX);
+    uarts[nport]->echo = 0;
+    fifo_write(uarts[nport]);
+    if (enable) {
+        uarts[nport]->flags |= F_RS485;
+    }
+    _enable();
+
+    // The transmission could be in progress.
+    tx_kick(nport);
+
+    sioerrno = SIO_ERR_NONE;
+    return 0;
+}
+
+/*!
+ * Returns the time when port \a nport in the RS-485 mode has released
+ * the bus last time, to measure the response time of the slave device.
+ * \param nport Port number as sio_com_t.
+ * \return Time by the counter tio_now(), in us, or 0 on error.
+ */
+u16 sio_get_turnaround(sio_com_t nport)
+{
+    if (!uarts[nport]) {
+        return 0;
+    }
+    rs485_poll(nport);
+    _disable();
+    u16 t = uarts[nport]->turnaround;
+    _enable();
+    return t;
+}
+
+/*!
+ * Send to port \a nport byte array \a buf of length \a len.
+ * \param nport Port number as sio_com_t.
+ * \param buf A pointer to an array of bytes.
+ * \param len Number of bytes to transfer.
+ * \return -1 on error or number of bytes transferred.
+ */
+int sio_send(sio_com_t nport, const char *buf, int len)
+{
+    if (!uarts[nport]) { return -1; }
+
+    int bytes_written = 0;
+    int is_block_mode = (F_BLOCK_MODE & uarts[nport]->flags);
+
+    for (;;) {
+
+        int bytes_to_write = tx_put(nport, buf, len);
+
+        buf += bytes_to_write;
+        bytes_written += bytes_to_write;
+        len -= bytes_to_write;
+
+        if (is_block_mode) {
+            if (!len) {
+                break;
+            }
+            if (F_POLLED & uarts[nport]->flags) {
+                port_poll(nport);
+            }
+        } else {
+            break;
+        }
+    }
+    return bytes_written;
+}
+
+/*!
+ * Received from the port \a nport byte array \a buf of length \a len.
+ * \param nport Port number as sio_com_t.
+ * \param buf A pointer to an array of bytes.
+ * \param len Number of bytes to receive.
+ * \return -1 on error.
+ */
+int sio_recv(sio_com_t nport, char *buf, int len)
+{
+    if (!uarts[nport]) {
+        return -1;
+    }
+
+    int bytes_readed = 0;
+    int is_block_mode = (F_BLOCK_MODE & uarts[nport]->flags);
+
+    for (;;) {
+
+        // The queue can only get more data while we copy,
+        // so the copy is done without disabling interrupts.
+        int bytes_to_read = rx_chars(uarts[nport]);
+        if (bytes_to_read > len) {
+            bytes_to_read = len;
+        }
+
+        if (F_RX_LARGE & uarts[nport]->flags) {
+            bytes_to_read = large_get(uarts[nport], buf, bytes_to_read);
+            buf += bytes_to_read;
+        } else if (bytes_to_read) {
+
+            // Copy and release the cells for the ISR.
+            queue_get(&uarts[nport]->rx, (F_POW2_BUFFERS & uarts[nport]->flags), buf, bytes_to_read);
+            rx_release(nport);
+
+            buf += bytes_to_read;
+
+        }//bytes_to_read > 0
+
+        bytes_readed += bytes_to_read;
+        len -= bytes_to_read;
+
+        if (is_block_mode) {
+            if (!len) {
+                break;
+            }
+            if (F_POLLED & uarts[nport]->flags) {
+                port_poll(nport);
+            }
+        } else {
+            break;
+        }
+    }
+    return bytes_readed;
+}
+
+/*!
+ * Sends to port \a nport byte array \a buf of length \a len followed by
+ * its CRC-16 (Modbus, low byte first). The CRC is computed while the bytes
+ * are copied to the output queue.
+ * In the non-blocking mode the frame is sent only if it fits whole
+ * in the output queue, else 0 is returned.
+ * \param nport Port number as sio_com_t.
+ * \param buf A pointer to an array of bytes.
+ * \param len Number of bytes to transfer, without the CRC.
+ * \return -1 on error or number of bytes transferred, with the CRC.
+ */
+int sio_send_crc(sio_com_t nport, const char *buf, int len)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
+    }
+
+    if (len < 0) {
+        sioerrno = SIO_ERR_INVALID_BUFFER_SIZE;
+        return -1;
+    }
+
+    sioerrno = SIO_ERR_NONE;
+
+    // A part of the frame is useless.
+    if ((!(F_BLOCK_MODE & uarts[nport]->flags)) && (queue_free(&uarts[nport]->tx) < (len + 2))) {
+        return 0;
+    }
+
+    u16 crc = SIO_CRC16_INIT;
+    char tail[2];
+    int done = 0; // Bytes of the frame and of the CRC already copied.
+
+    for (;;) {
+
+        // The queue can only get more free space while we copy,
+        // so the copy is done without disabling interrupts.
+        int bytes_free = queue_free(&uarts[nport]->tx);
+        int bytes_to_write = 0;
+        u16 in = uarts[nport]->tx.in;
+
+        if ((done < len) && bytes_free) {
+            bytes_to_write = len - done;
+            if (bytes_to_write > bytes_free) {
+                bytes_to_write = bytes_free;
+            }
+            in = tx_copy_crc(nport, in, buf + done, bytes_to_write, &crc);
+            bytes_free -= bytes_to_write;
+            done += bytes_to_write;
+        }
+
+        if ((done >= len) && bytes_free) {
+            if (done == len) {
+                tail[0] = (char)crc;
+                tail[1] = (char)(crc >> 8);
+            }
+            int sizecpy = (len + 2) - done;
+            if (sizecpy > bytes_free) {
+                sizecpy = bytes_free;
+            }
+            in = tx_copy(nport, in, tail + (done - len), sizecpy);
+            bytes_to_write += sizecpy;
+            done += sizecpy;
+        }
+
+        if (bytes_to_write) {
+            // Publish the data for the ISR.
+            uarts[nport]->tx.in = in;
+            tx_update_peak(uarts[nport]);
+            tx_kick(nport);
+        }
+
+        if (done == (len + 2)) {
+            break;
+        }
+        if (F_POLLED & uarts[nport]->flags) {
+            port_poll(nport);
+        }
+    }
+    return done;
+}
+
+/*!
+ * Sends to port \a nport the segments \a iov of number \a cnt as one
+ * array of bytes, without assembling them into a temporary buffer.
+ * All segments, which fit in the output queue, are published
+ * for the ISR at once and the transmission is started once.
+ * \param nport Port number as sio_com_t.
+ * \param iov A pointer to an array of segments.
+ * \param cnt Number of segments.
+ * \return -1 on error or number of bytes transferred.
+ */
+int sio_sendv(sio_com_t nport, const sio_iovec_t *iov, int cnt)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
+    }
+
+    int i;
+    for (i = 0; i < cnt; ++i) {
+        if (iov[i].len < 0) {
+            sioerrno = SIO_ERR_INVALID_BUFFER_SIZE;
+            return -1;
+        }
+    }
+
+    sioerrno = SIO_ERR_NONE;
+
+    int bytes_written = 0;
+    int is_block_mode = (F_BLOCK_MODE & uarts[nport]->flags);
+    int done = 0; // Bytes of the segment i already copied.
+    i = 0;
+
+    for (;;) {
+
+        // The queue can only get more free space while we copy,
+        // so the copy is done without disabling interrupts.
+        int bytes_free = queue_free(&uarts[nport]->tx);
+        int bytes_to_write = 0;
+        u16 in = uarts[nport]->tx.in;
+
+        while ((i < cnt) && bytes_free) {
+            int sizecpy = iov[i].len - done;
+            if (sizecpy > bytes_free) {
+                sizecpy = bytes_free;
+            }
+            in = tx_copy(nport, in, (const char *)iov[i].base + done, sizecpy);
+            bytes_free -= sizecpy;
+            bytes_to_write += sizecpy;
+            done += sizecpy;
+            if (done == iov[i].len) { // Next segment.
+                ++i;
+                done = 0;
+            }
+        }
+
+        if (bytes_to_write) {
+            // Publish the data for the ISR.
+            uarts[nport]->tx.in = in;
+            tx_update_peak(uarts[nport]);
+            tx_kick(nport);
+            bytes_written += bytes_to_write;
+        }
+
+        if ((i == cnt) || (!is_block_mode)) {
+            break;
+        }
+        if (F_POLLED & uarts[nport]->flags) {
+            port_poll(nport);
+        }
+    }
+    return bytes_written;
+}
+
+/*!
+ * Starts the transfer to port \a nport of byte array \a buf of length \a len
+ * directly from the buffer of the caller, without copying it to the output queue,
+ * and returns at once regardless of the open mode.
+ *
+ * The bytes, which are in the output queue at the moment of the call, are transferred
+ * before the buffer, and the bytes sent later are transferred after it. The buffer must
+ * remain valid until the transfer is finished: \a done is called from the ISR, or
+ * sio_tx_pending() returns 0. Only one zero-copy transfer can be pending.
+ * \note The port COM_PGM is not supported.
+ * \param nport Port number as sio_com_t.
+ * \param buf A pointer to an array of bytes.
+ * \param len Number of bytes to transfer.
+ * \param done Completion callback, or 0.
+ * \return -1 on error (SIO_ERR_BUSY if a transfer is pending).
+ */
+int sio_send_zc(sio_com_t nport, const char *buf, int len, sio_done_t done)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
+    }
+
+#ifdef COM_PGM
+    if (SIO_COM_PGM == nport) {
+        sioerrno = SIO_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
+#endif
+
+    if (len < 0) {
+        sioerrno = SIO_ERR_INVALID_BUFFER_SIZE;
+        return -1;
+    }
+
+    // The flag is cleared only by the ISR.
+    if (F_TX_ZC & uarts[nport]->flags) {
+        sioerrno = SIO_ERR_BUSY;
+        return -1;
+    }
+
+    sioerrno = SIO_ERR_NONE;
+
+    if (!len) {
+        return 0;
+    }
+
+    _disable();
+    uarts[nport]->zc_buf = buf;
+    uarts[nport]->zc_data = buf;
+    uarts[nport]->zc_len = len;
+    uarts[nport]->zc_done = done;
+    uarts[nport]->zc_mark = uarts[nport]->tx.in;
+    uarts[nport]->flags |= F_TX_ZC;
+    _enable();
+
+    tx_kick(nport);
+    return 0;
+}
+
+/*!
+ * Returns number of bytes of port \a nport waiting for the transfer,
+ * in the output queue and in the zero-copy transfer.
+ * \param nport Port number as sio_com_t.
+ * \return Number of bytes or 0 on error.
+ */
+int sio_tx_pending(sio_com_t nport)
+{
+    if (!uarts[nport]) {
+        return 0;
+    }
+    rs485_poll(nport);
+    return queue_chars(&uarts[nport]->tx) + uarts[nport]->zc_len;
+}
+
+/*!
+ * Gives direct access to the free space of the output queue of port \a nport,
+ * so the data can be written there without copying. The free space may be split
+ * by the border of the ring buffer, so it is returned as two contiguous regions:
+ * \a ptr1 of length \a len1 and \a ptr2 of length \a len2 (\a len2 is 0
+ * if the space is not split). The written data is not transferred until
+ * sio_tx_commit() is called, and nothing else must be sent before it.
+ * \param nport Port number as sio_com_t.
+ * \param ptr1 Returns a pointer to the first region.
+ * \param len1 Returns the length of the first region, in bytes.
+ * \param ptr2 Returns a pointer to the second region (the beginning of the ring buffer).
+ * \param len2 Returns the length of the second region, in bytes.
+ * \return -1 on error or total number of free bytes (\a len1 + \a len2).
+ */
+int sio_tx_reserve(sio_com_t nport, char **ptr1, int *len1, char **ptr2, int *len2)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
+    }
+
+    // Take a snapshot, the ISR only frees more space after it.
+    int in = uarts[nport]->tx.in;
+    int bytes_free = queue_free(&uarts[nport]->tx);
+
+    // It is on the border of the ring buffer?
+    int sizecpy = ((in + bytes_free) <= uarts[nport]->tx.size) ? (bytes_free) : (uarts[nport]->tx.size - in);
+
+    *ptr1 = uarts[nport]->tx.data + in;
+    *len1 = sizecpy;
+    *ptr2 = uarts[nport]->tx.data;
+    *len2 = bytes_free - sizecpy;
+
+    sioerrno = SIO_ERR_NONE;
+    return bytes_free;
+}
+
+/*!
+ * Publishes for the transfer \a n bytes written to the output queue of port \a nport
+ * through sio_tx_reserve(), and starts the transmission.
+ * \param nport Port number as sio_com_t.
+ * \param n Number of bytes to transfer.
+ * \return -1 on error or number of bytes transferred.
+ */
+int sio_tx_commit(sio_com_t nport, int n)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
+    }
+
+    if ((n < 0) || (n > queue_free(&uarts[nport]->tx))) {
+        sioerrno = SIO_ERR_INVALID_BUFFER_SIZE;
+        return -1;
+    }
+
+    if (n) {
+        int in = uarts[nport]->tx.in + n;
+        // A pointer to an next empty cell is outside the ring buffer?
+        if (F_POW2_BUFFERS & uarts[nport]->flags) {
+            in &= uarts[nport]->tx.mask;
+        } else if (in >= uarts[nport]->tx.size) {
+            in -= uarts[nport]->tx.size;
+        }
+        uarts[nport]->tx.in = in; // Publish the data for the ISR.
+        tx_update_peak(uarts[nport]);
+        tx_kick(nport);
+    }
+
+    sioerrno = SIO_ERR_NONE;
+    return n;
+}
+
+/*!
+ * Sends to port \a nport byte array \a buf of length \a len, and waits for
+ * the free space in the output queue no more than \a timeout_ms, regardless
+ * of the open mode. While waiting the CPU is halted until the next interrupt.
+ * \param nport Port number as sio_com_t.
+ * \param buf A pointer to an array of bytes.
+ * \param len Number of bytes to transfer.
+ * \param timeout_ms Timeout, in ms.
+ * \return -1 on error or number of bytes transferred. If it is less than
+ * \a len, the error is SIO_ERR_TIMEOUT.
+ */
+int sio_send_timeout(sio_com_t nport, const char *buf, int len, u32 timeout_ms)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
+    }
+
+    if (-1 == tio_init(0)) {
+        sioerrno = SIO_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
+
+    sioerrno = SIO_ERR_NONE;
+
+    tio_deadline_t deadline;
+    tio_deadline(&deadline, timeout_ms);
+
+    int bytes_written = 0;
+    for (;;) {
+        int bytes_to_write = tx_put(nport, buf, len);
+
+        buf += bytes_to_write;
+        bytes_written += bytes_to_write;
+        len -= bytes_to_write;
+
+        if (!len) {
+            break;
+        }
+        if (tio_expired(&deadline)) {
+            sioerrno = SIO_ERR_TIMEOUT;
+            break;
+        }
+
+        // Wait for the ISR to free the cells.
+        if (F_POLLED & uarts[nport]->flags) {
+            port_poll(nport);
+            continue;
+        }
+        _disable();
+        if (queue_free(&uarts[nport]->tx)) {
+            _enable();
+        } else {
+            tio_idle();
+        }
+    }
+    return bytes_written;
+}
+
+/*!
+ * Receives from port \a nport byte array \a buf of length \a len, and waits
+ * for the data no more than \a timeout_ms, regardless of the open mode.
+ * While waiting the CPU is halted until the next interrupt.
+ * \param nport Port number as sio_com_t.
+ * \param buf A pointer to an array of bytes.
+ * \param len Number of bytes to receive.
+ * \param timeout_ms Timeout, in ms.
+ * \return -1 on error or number of bytes received. If it is less than
+ * \a len, the error is SIO_ERR_TIMEOUT.
+ */
+int sio_recv_timeout(sio_com_t nport, char *buf, int len, u32 timeout_ms)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
+    }
+
+    if (-1 == tio_init(0)) {
+        sioerrno = SIO_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
+
+    sioerrno = SIO_ERR_NONE;
+
+    tio_deadline_t deadline;
+    tio_deadline(&deadline, timeout_ms);
+
+    int bytes_readed = 0;
+    for (;;) {
+        int bytes_to_read = rx_chars(uarts[nport]);
+        if (bytes_to_read > len) {
+            bytes_to_read = len;
+        }
+
+        if (F_RX_LARGE & uarts[nport]->flags) {
+            bytes_to_read = large_get(uarts[nport], buf, bytes_to_read);
+            buf += bytes_to_read;
+            bytes_readed += bytes_to_read;
+            len -= bytes_to_read;
+        } else if (bytes_to_read) {
+            // Copy and release the cells for the ISR.
+            queue_get(&uarts[nport]->rx, (F_POW2_BUFFERS & uarts[nport]->flags), buf, bytes_to_read);
+            rx_release(nport);
+            buf += bytes_to_read;
+            bytes_readed += bytes_to_read;
+            len -= bytes_to_read;
+        }
+
+        if (!len) {
+            break;
+        }
+        if (tio_expired(&deadline)) {
+            sioerrno = SIO_ERR_TIMEOUT;
+            break;
+        }
+
+        // Wait for the ISR to receive the data.
+        if (F_POLLED & uarts[nport]->flags) {
+            port_poll(nport);
+            continue;
+        }
+        _disable();
+        if (queue_chars(&uarts[nport]->rx) || large_chars(&uarts[nport]->large)) {
+            _enable();
+        } else {
+            tio_idle();
+        }
+    }
+    return bytes_readed;
+}
+
+/*!
+ * Clears a queue transmitting or receiving of port \a nport
+ * depending on a parameter \a dir.
+ * \param nport Port number as sio_com_t.
+ * \param dir Direction of the transmit/receive as sio_dir_t (you can install them on the OR).
+ * \return -1 on error.
+ */
+int sio_clear(sio_com_t nport, sio_dir_t dir)
+{
+    if (uarts[nport] /*sio_exists(nport)*/ ) {
+        if (SIO_TX_DIRECTION & dir) {
+            // The output index belongs to the ISR.
+            _disable();
+            uarts[nport]->tx.in = uarts[nport]->tx.out;
+            // Cancel the zero-copy transfer.
+            uarts[nport]->zc_len = 0;
+            uarts[nport]->flags &= ~F_TX_ZC;
+            _enable();
+        }
+        if (SIO_RX_DIRECTION & dir) {
+            // The frame index belongs to the ISR too.
+            _disable();
+            uarts[nport]->rx.out = uarts[nport]->rx.in;
+            uarts[nport]->large.out = uarts[nport]->large.in;
+            uarts[nport]->frame_out = uarts[nport]->frame_in;
+            uarts[nport]->frame_open = 0;
+            uarts[nport]->frame_ev = 0;
+            _enable();
+            rx_release(nport);
+        }
+        return 0;
+    }
+    return -1;
+}
+
+/*!
+ * Returns number of bytes in the port \a nport available to read.
+ * \param nport Port number as sio_com_t.
+ * \return Number of bytes available for reading or 0 on error.
+ */
+int sio_rx_available(sio_com_t nport)
+{
+    return (uarts[nport]) ? (rx_chars(uarts[nport])) : (0);
+}
+
+/*!
+ * Sets the large input queue of port \a nport, made of \a cnt far blocks of
+ * SIO_LARGE_BLOCK bytes each (for example, allocated by _fmalloc() in the far heap),
+ * so the queue is not limited by the data segment.
+ * The large queue is used instead of the input queue given to sio_open(),
+ * the received data, which is not read yet, is discarded. One cell always
+ * remains empty. The framing, the RX events, sio_rx_peek() and the flow control
+ * by the driver are not supported with the large queue.
+ * The blocks must stay valid until the large queue is removed or
+ * the port is closed.
+ * \param nport Port number as sio_com_t.
+ * \param blocks A pointer to an array of pointers to the blocks,
+ * or 0 to return to the input queue of sio_open().
+ * \param cnt Number of the blocks.
+ * \return -1 on error.
+ */
+int sio_set_rx_large(sio_com_t nport, char __far **blocks, int cnt)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
+    }
+
+    if (blocks && ((cnt <= 0) || (cnt > SIO_LARGE_BLOCKS_MAX))) {
+        sioerrno = SIO_ERR_INVALID_BUFFER_SIZE;
+        return -1;
+    }
+
+    if (blocks && ((F_RX_FRAMING | F_RX_NOTIFY | F_RTS_FLOW) & uarts[nport]->flags)) {
+        sioerrno = SIO_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
+
+    _disable();
+    uarts[nport]->large.blocks = blocks;
+    uarts[nport]->large.size = (blocks) ? ((u32)cnt << LARGE_SHIFT) : (0);
+    uarts[nport]->large.in = 0;
+    uarts[nport]->large.out = 0;
+    uarts[nport]->rx.out = uarts[nport]->rx.in;
+    if (blocks) {
+        uarts[nport]->flags |= F_RX_LARGE;
+    } else {
+        uarts[nport]->flags &= ~F_RX_LARGE;
+    }
+    _enable();
+
+    sioerrno = SIO_ERR_NONE;
+    return 0;
+}
+
+/*!
+ * Gives direct access to the data received by port \a nport without copying.
+ * The received data may be split by the border of the ring buffer, so it is
+ * returned as two contiguous regions: \a ptr1 of length \a len1 and
+ * \a ptr2 of length \a len2 (\a len2 is 0 if the data is not split).
+ * The data remains in the input queue until sio_rx_consume() is called.
+ * \param nport Port number as sio_com_t.
+ * \param ptr1 Returns a pointer to the first region.
+ * \param len1 Returns the length of the first region, in bytes.
+ * \param ptr2 Returns a pointer to the second region (the beginning of the ring buffer).
+ * \param len2 Returns the length of the second region, in bytes.
+ * \return -1 on error or total number of bytes available (\a len1 + \a len2).
+ */
+int sio_rx_peek(sio_com_t nport, const char **ptr1, int *len1, const char **ptr2, int *len2)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
+    }
+
+    if (F_RX_LARGE & uarts[nport]->flags) {
+        sioerrno = SIO_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
+
+    // Take a snapshot, the ISR only appends after it.
+    int out = uarts[nport]->rx.out;
+    int chars = queue_chars(&uarts[nport]->rx);
+
+    // It is on the border of the ring buffer?
+    int sizecpy = ((out + chars) <= uarts[nport]->rx.size) ? (chars) : (uarts[nport]->rx.size - out);
+
+    *ptr1 = uarts[nport]->rx.data + out;
+    *len1 = sizecpy;
+    *ptr2 = uarts[nport]->rx.data;
+    *len2 = chars - sizecpy;
+
+    sioerrno = SIO_ERR_NONE;
+    return chars;
+}
+
+/*!
+ * Removes \a n bytes from the beginning of the input queue of port \a nport,
+ * which previously been inspected through sio_rx_peek().
+ * \param nport Port number as sio_com_t.
+ * \param n Number of bytes to discard.
+ * \return -1 on error or number of bytes discarded.
+ */
+int sio_rx_consume(sio_com_t nport, int n)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
+    }
+
+    if (F_RX_LARGE & uarts[nport]->flags) {
+        sioerrno = SIO_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
+
+    int chars = queue_chars(&uarts[nport]->rx);
+    if (n > chars) {
+        n = chars;
+    }
+
+    if (n > 0) {
+        int out = uarts[nport]->rx.out + n;
+        // A pointer to an next cell is outside the ring buffer?
+        if (F_POW2_BUFFERS & uarts[nport]->flags) {
+            out &= uarts[nport]->rx.mask;
+        } else if (out >= uarts[nport]->rx.size) {
+            out -= uarts[nport]->rx.size;
+        }
+        uarts[nport]->rx.out = out; // Release the cells for the ISR.
+        rx_release(nport);
+    } else {
+        n = 0;
+    }
+
+    sioerrno = SIO_ERR_NONE;
+    return n;
+}
+
+/*!
+ * Sets the RX FIFO trigger level of port \a nport.
+ *
+ * The lower level reduces the latency of the received data at the low
+ * baud rates, the higher level reduces the number of interrupts.
+ * If \a level is SIO_FIFO_ADAPTIVE, the ISR itself lowers the level when
+ * the traffic is sparse and raises it under a sustained stream; watch the
+ * result with sio_get_fifo_trigger() and with the counters \a rx_irqs and
+ * \a rx_timeouts of sio_get_stats().
+ * In the framing mode closed by the timeout interrupt (see sio_set_rx_framing())
+ * the level 1 is raised to the next one.
+ * \note The port COM_PGM has no FIFO.
+ * \param nport Port number as sio_com_t.
+ * \param level Desired level, in bytes, is rounded down to the supported
+ * levels 1, 4, 8 or 14; or SIO_FIFO_ADAPTIVE.
+ * \return -1 on error.
+ */
+int sio_set_fifo_trigger(sio_com_t nport, int level)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
+    }
+
+#ifdef COM_PGM
+    if (SIO_COM_PGM == nport) {
+        sioerrno = SIO_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
+#endif
+
+    if ((SIO_FIFO_ADAPTIVE != level) && (level < 1)) {
+        sioerrno = SIO_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
+
+    _disable();
+    if (SIO_FIFO_ADAPTIVE == level) {
+        uarts[nport]->adapt_irqs = 0;
+        uarts[nport]->adapt_rdto = 0;
+        uarts[nport]->adapt_clean = 0;
+        uarts[nport]->adapt_hold = 1;
+        uarts[nport]->flags |= F_FIFO_ADAPTIVE;
+        // Start with the lowest latency.
+        fifo_set_trigger(uarts[nport], fifo_min_itl(uarts[nport]));
+    } else {
+        int itl = 3;
+        while ((itl > fifo_min_itl(uarts[nport])) && (uarts[nport]->levels[itl] > level)) {
+            --itl;
+        }
+        uarts[nport]->flags &= ~F_FIFO_ADAPTIVE;
+        fifo_set_trigger(uarts[nport], itl);
+    }
+    _enable();
+
+    sioerrno = SIO_ERR_NONE;
+    return 0;
+}
+
+/*!
+ * Returns the current RX FIFO trigger level of port \a nport.
+ * \param nport Port number as sio_com_t.
+ * \return -1 on error or the level, in bytes.
+ */
+int sio_get_fifo_trigger(sio_com_t nport)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
+    }
+#ifdef COM_PGM
+    if (SIO_COM_PGM == nport) {
+        return 1; // Each byte is an interrupt.
+    }
+#endif
+    return uarts[nport]->rx_trigger;
+}
+
+/*!
+ * Services all ports opened in the mode SIO_POLLED in a single pass:
+ * reads their RX FIFOs into the input queues and fills their TX FIFOs
+ * from the output queues. The function can be called from the main loop
+ * or from a timer tick, and it must be called often enough so that the RX FIFO
+ * does not overflow (16 characters at the FIFO trigger level 14).
+ * \note Interrupts are disabled while a port is served.
+ * \return Number of the ports, which had a work.
+ */
+int sio_poll_all(void)
+{
+    int n = 0;
+    for (int nport = 0; nport < 4; ++nport) {
+        if (uarts[nport] && (F_POLLED & uarts[nport]->flags)) {
+            if (port_poll((sio_com_t)nport)) {
+                ++n;
+            }
+        }
+    }
+    return n;
+}
+
+/*!
+ * Reads the capabilities of the UART of port \a nport, detected by sio_open().
+ * \param nport Port number as sio_com_t.
+ * \param caps Pointer to the structure to which the capabilities are copied.
+ * \return -1 on error.
+ */
+int sio_get_caps(sio_com_t nport, sio_caps_t *caps)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
     }
+    caps->type = (sio_uart_type_t)uarts[nport]->type;
+    caps->rx_fifo = (SIO_UART_16750 == uarts[nport]->type) ? (64) : (uarts[nport]->tx_fifo);
+    caps->tx_fifo = uarts[nport]->tx_fifo;
+    caps->auto_flow = ((SIO_UART_16750 == uarts[nport]->type) || (SIO_UART_16C950 == uarts[nport]->type));
+    sioerrno = SIO_ERR_NONE;
     return 0;
 }
 
 /*!
- * Configures an open port \a nport, and sets desired
- * rate \a baud, parity \a parity, number of data bits \a databits,
- * number of stop bits \a stopbits.
+ * Reads the statistics of port \a nport.
  * \param nport Port number as sio_com_t.
- * \param baud Desired rate as sio_speed_t.
- * \param parity Desired parity as sio_parity_t.
- * \param databits Desired data bits as sio_databits_t.
- * \param stopbits Desired stop bits as sio_stopbits_t.
+ * \param stats Pointer to the structure to which the statistics is copied.
  * \return -1 on error.
  */
-int sio_configure(sio_com_t nport, sio_speed_t baud, sio_parity_t parity, sio_databits_t databits, sio_stopbits_t stopbits)
+int sio_get_stats(sio_com_t nport, sio_stats_t *stats)
 {
     if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
         return -1;
     }
+    // The counters are updated by the ISR.
+    _disable();
+    memcpy(stats, &uarts[nport]->stats, sizeof(sio_stats_t));
+    _enable();
+    sioerrno = SIO_ERR_NONE;
+    return 0;
+}
 
-    sioerrno = SIO_ERR_ILLEGAL_SETTING; // Forse error set.
-
-#ifdef COM_PGM // PGM configure.
-
-    if (SIO_COM_PGM == nport) {
-        _disable();
-        switch (baud) {
-        case SIO_BPS_50: outpw(uarts[SIO_COM_PGM]->addr.mcr, 24999); break;
-        case SIO_BPS_300: outpw(uarts[SIO_COM_PGM]->addr.mcr, 4165); break;
-        case SIO_BPS_600: outpw(uarts[SIO_COM_PGM]->addr.mcr, 2082); break;
-        case SIO_BPS_2400: outpw(uarts[SIO_COM_PGM]->addr.mcr, 519); break;
-        case SIO_BPS_4800: outpw(uarts[SIO_COM_PGM]->addr.mcr, 259); break;
-        case SIO_BPS_9600: outpw(uarts[SIO_COM_PGM]->addr.mcr, 129); break;
-        case SIO_BPS_19200: outpw(uarts[SIO_COM_PGM]->addr.mcr, 64); break;
-        case SIO_BPS_38400: outpw(uarts[SIO_COM_PGM]->addr.mcr, 31); break;
-        case SIO_BPS_57600: outpw(uarts[SIO_COM_PGM]->addr.mcr, 20); break;
-        case SIO_BPS_115200: outpw(uarts[SIO_COM_PGM]->addr.mcr, 9); break;
-        default:;
-        }
+/*!
+ * Enables or disables the framing mode of port \a nport.
+ *
+ * In the framing mode the ISR timestamps the received bytes with the counter
+ * tio_now() and splits them into frames by the pauses of the line: a frame
+ * is closed when the line is idle for \a idle_half_chars halves of the time
+ * of one character (for Modbus RTU it is SIO_FRAME_T35). The complete frames
+ * are returned whole by sio_recv_frame(); don't mix it with sio_recv() and
+ * sio_rx_consume(), they ignore the frames.
+ *
+ * The idle time is limited by 32 ms, so use the rates 1200 baud and up.
+ * On a UART with FIFO and the idle time up to 4 characters (SIO_FRAME_T35)
+ * the frame is closed by the timeout interrupt: the ISR leaves the last
+ * received character in the FIFO, so the RX FIFO trigger level is at least 4.
+ * On COM_PGM, on the UARTs without FIFO and with the longer idle time the frame
+ * is closed by the next frame or by sio_rx_frames() and sio_recv_frame().
+ * \note The function must be called after sio_configure(),
+ * and it starts the counter by tio_init(0) if it is not started yet.
+ * \param nport Port number as sio_com_t.
+ * \param idle_half_chars Idle time which closes a frame, in half characters, or 0 to disable.
+ * \return -1 on error.
+ */
+int sio_set_rx_framing(sio_com_t nport, int idle_half_chars)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
+    }
 
-        int r = inpw(uarts[SIO_COM_PGM]->addr.lcr) & 0xFF87; // Clear bits.
-        switch (parity) {
-        case SIO_PAR_NONE: break;
-        case SIO_PAR_EVEN: r |= 0x0060; break;
-        case SIO_PAR_ODD: r |= 0x0040; break;
-        default: return -1;
-        }
+    if ((idle_half_chars < 0) || (idle_half_chars && ((!uarts[nport]->char_us) || (F_RX_LARGE & uarts[nport]->flags)))) {
+        sioerrno = SIO_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
 
-        switch (databits) {
-        case SIO_DATA7: break;
-        case SIO_DATA8: r |= 0x0010; break;
-        default: return -1;
-        }
+    if (idle_half_chars && (-1 == tio_init(0))) {
+        sioerrno = SIO_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
 
-        switch (stopbits) {
-        case SIO_STOP1: break;
-        case SIO_STOP2: r |= 0x0008; break;
-        default:;
-        }
+    _disable();
+    uarts[nport]->frame_half_chars = idle_half_chars;
+    uarts[nport]->frame_open = 0;
+    uarts[nport]->frame_in = 0;
+    uarts[nport]->frame_out = 0;
+    uarts[nport]->frame_ev = 0;
+    if (idle_half_chars) {
+        uarts[nport]->flags |= F_RX_FRAMING;
+    } else {
+        uarts[nport]->flags &= ~F_RX_FRAMING;
+    }
+    frame_set_idle(uarts[nport]);
+    _enable();
 
-        outpw (uarts[SIO_COM_PGM]->addr.lcr, r); // Set new parameters.
-        _enable();
+    sioerrno = SIO_ERR_NONE;
+    return 0;
+}
 
-        sioerrno = SIO_ERR_NONE;
+/*!
+ * Returns number of complete frames received by port \a nport in the framing mode.
+ * \param nport Port number as sio_com_t.
+ * \return Number of frames or 0 on error.
+ */
+int sio_rx_frames(sio_com_t nport)
+{
+    if ((!uarts[nport]) || (!(F_RX_FRAMING & uarts[nport]->flags))) {
         return 0;
     }
+    if (F_POLLED & uarts[nport]->flags) {
+        port_poll(nport);
+    }
+    frame_poll(nport);
+    int frames = uarts[nport]->frame_in - uarts[nport]->frame_out;
+    return (frames < 0) ? (frames + FRAMES) : (frames);
+}
 
-#endif
-
-    // Configure "standard" UART.
-    _disable();
-    // 1 = DLLB, DLHB accessible.
-    outp(uarts[nport]->addr.lcr, (inp(uarts[nport]->addr.lcr) | SIO_LCR_DLAB));
-    // Set baud rate.
-    outpw(uarts[nport]->addr.base, baud);
-    // 0 = RB accessible.
-    outp(uarts[nport]->addr.lcr, (inp(uarts[nport]->addr.lcr) & (~SIO_LCR_DLAB)));
-    _enable();
+/*!
+ * Enables or disables the computation of CRC-16 (Modbus) of the received frames
+ * of port \a nport by the ISR, in the framing mode (see sio_set_rx_framing()).
+ * The CRC is computed as the characters enter the input queue, and it is
+ * returned by sio_recv_frame_crc() without one more pass over the frame.
+ * \param nport Port number as sio_com_t.
+ * \param enable Not 0 to enable.
+ * \return -1 on error.
+ */
+int sio_set_rx_crc(sio_com_t nport, int enable)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
+    }
 
     _disable();
-    // Set other's parameters.
-    outp(uarts[nport]->addr.lcr, (parity | databits | stopbits));
+    // The frame being received is not complete, it gets the CRC from the next one.
+    uarts[nport]->frame_open = 0;
+    uarts[nport]->rx_crc_on = (enable) ? (1) : (0);
     _enable();
 
     sioerrno = SIO_ERR_NONE;
@@ -678,190 +3542,243 @@ int sio_configure(sio_com_t nport, sio_speed_t baud, sio_parity_t parity, sio_da
 }
 
 /*!
- * Send to port \a nport byte array \a buf of length \a len.
- * \param nport Port number as sio_com_t.
+ * Computes CRC-16 (Modbus) of byte array \a buf of length \a len.
+ * \param crc Initial value: SIO_CRC16_INIT or the CRC of the previous part of the array.
  * \param buf A pointer to an array of bytes.
- * \param len Number of bytes to transfer.
- * \return -1 on error or number of bytes transferred.
+ * \param len Number of bytes.
+ * \return CRC-16. The CRC of an array with the valid CRC appended is 0.
  */
-int sio_send(sio_com_t nport, const char *buf, int len)
+u16 sio_crc16(u16 crc, const char *buf, int len)
 {
-    if (!uarts[nport]) { return -1; }
-
-    int bytes_written = 0;
-    int is_block_mode = (F_BLOCK_MODE & uarts[nport]->flags);
-
-    for (;;) {
-
-        _disable();
-
-        // This code is valid for disabling interrupts!!!
-        int bytes_to_write = ((uarts[nport]->tx.chars + len) > uarts[nport]->tx.size) ?
-                    (uarts[nport]->tx.size - uarts[nport]->tx.chars) : (len);
-
-        if (bytes_to_write) {
-
-            // How many to copy to the ring buffer?
-            // It is on the border of the ring buffer?
-            int sizecpy = ((uarts[nport]->tx.in + bytes_to_write) <= uarts[nport]->tx.size) ?
-                        (bytes_to_write) : (uarts[nport]->tx.size - uarts[nport]->tx.in);
+    while (len-- > 0) {
+        crc = CRC_ADD(crc, (unsigned char)*buf++);
+    }
+    return crc;
+}
 
-            // Copy to the boundary of the ring buffer
-            memcpy(uarts[nport]->tx.data + uarts[nport]->tx.in, buf, sizecpy);
+/*!
+ * Receives from port \a nport one complete frame to the array \a buf
+ * of size \a size, in the framing mode (see sio_set_rx_framing()).
+ * In the blocking mode waits for a frame, else returns 0 if there is no frame.
+ * \param nport Port number as sio_com_t.
+ * \param buf A pointer to an array of bytes.
+ * \param size Size of the array \a buf, in bytes.
+ * \return -1 on error or length of the frame. If the frame is longer
+ * than \a size, it is discarded with the error SIO_ERR_INVALID_BUFFER_SIZE.
+ */
+int sio_recv_frame(sio_com_t nport, char *buf, int size)
+{
+    return sio_recv_frame_crc(nport, buf, size, 0);
+}
 
-            if (sizecpy < bytes_to_write) { // This is not all?
-                sizecpy = bytes_to_write - sizecpy; // Compute the remainder.
-                uarts[nport]->tx.in = 0; // Beginning of the buffer.
-                // Copy the remainder to the beginning of the ring buffer.
-                memcpy(uarts[nport]->tx.data, buf + (bytes_to_write - sizecpy), sizecpy);
-            }
+/*!
+ * Same as sio_recv_frame(), and returns CRC-16 (Modbus) of the frame to \a crc.
+ * For a frame with the valid CRC it is 0. The CRC is computed by the ISR,
+ * if enabled by sio_set_rx_crc(), else over the copied frame.
+ * \param nport Port number as sio_com_t.
+ * \param buf A pointer to an array of bytes.
+ * \param size Size of the array \a buf, in bytes.
+ * \param crc Pointer to the CRC of the frame, or 0.
+ * \return -1 on error or length of the frame.
+ */
+int sio_recv_frame_crc(sio_com_t nport, char *buf, int size, u16 *crc)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
+    }
 
-            uarts[nport]->tx.in += sizecpy; // A pointer to an next empty cell, the ring buffer.
-            uarts[nport]->tx.chars += bytes_to_write; // Increment number of bytes for transfer.
+    if (!(F_RX_FRAMING & uarts[nport]->flags)) {
+        sioerrno = SIO_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
 
-            // A pointer to an empty cell, the ring buffer outside the buffer size?
-            if (uarts[nport]->tx.in >= uarts[nport]->tx.size) {
-                uarts[nport]->tx.in = 0;
-            }
+    sioerrno = SIO_ERR_NONE;
 
-            // Start interrupt for transfer.
-#ifdef COM_PGM // PGM transfer.
-            if (SIO_COM_PGM == nport) {
-                if (!(inpw(uarts[SIO_COM_PGM]->addr.lcr) & 0x0800)) {
-                    outpw(uarts[SIO_COM_PGM]->addr.lcr, inpw(uarts[SIO_COM_PGM]->addr.lcr) | 0x0800);
-                }
+    while (uarts[nport]->frame_out == uarts[nport]->frame_in) {
+        if (F_POLLED & uarts[nport]->flags) {
+            port_poll(nport);
+        }
+        frame_poll(nport);
+        if ((uarts[nport]->frame_out == uarts[nport]->frame_in)
+                && (!(F_BLOCK_MODE & uarts[nport]->flags))) {
+            return 0;
+        }
+        // Wait for the ISR to close the frame, else the idle line
+        // is detected by frame_poll().
+        if ((!(F_POLLED & uarts[nport]->flags)) && uarts[nport]->frame_rdto) {
+            _disable();
+            if (uarts[nport]->frame_out != uarts[nport]->frame_in) {
+                _enable();
             } else {
-#endif
-                if (inp(uarts[nport]->addr.lsr) & 0x20) { // No transmission?
-                    uarts[nport]->tx.chars--;
-                    // Byte transfer.
-                    outp(uarts[nport]->addr.base, uarts[nport]->tx.data[uarts[nport]->tx.out++]);
-                    // Transmission pointer a buffer is out boundary?
-                    if (uarts[nport]->tx.out == uarts[nport]->tx.size) {
-                        uarts[nport]->tx.out = 0;
-                    }
-                }
-#ifdef COM_PGM
+                tio_idle();
             }
-#endif
-
-        }//bytes_to_write > 0
+        }
+    }
 
-        _enable();
+    sio_frame_t *frame = &uarts[nport]->frames[uarts[nport]->frame_out];
+    int len = frame->len;
 
-        bytes_written += bytes_to_write;
-        len -= bytes_to_write;
+    // Skip the characters before the frame (e.g. the tail of a frame
+    // which was being received when the framing mode was enabled).
+    uarts[nport]->rx.out = frame->start;
 
-        if (is_block_mode) {
-            if (!len) {
-                break;
-            }
-        } else {
-            break;
+    if (len > size) {
+        sio_rx_consume(nport, len);
+        sioerrno = SIO_ERR_INVALID_BUFFER_SIZE;
+        len = -1;
+    } else {
+        // Copy and release the cells for the ISR.
+        queue_get(&uarts[nport]->rx, (F_POW2_BUFFERS & uarts[nport]->flags), buf, len);
+        rx_release(nport);
+        if (crc) {
+            *crc = (uarts[nport]->rx_crc_on) ? (frame->crc) : (sio_crc16(SIO_CRC16_INIT, buf, len));
         }
     }
-    return bytes_written;
+
+    // Release the entry of the frame index for the ISR.
+    uarts[nport]->frame_out = (uarts[nport]->frame_out + 1) % FRAMES;
+    return len;
 }
 
 /*!
- * Received from the port \a nport byte array \a buf of length \a len.
+ * Sets the RX events of port \a nport.
+ *
+ * The ISR signals the event SIO_EV_WATERMARK when the number of bytes in
+ * the input queue reaches \a watermark, and the event SIO_EV_DELIMITER when
+ * the character \a delimiter is received. The events are accumulated in the
+ * bitmap read by sio_get_events(), and if \a notify is not 0, it is called
+ * from the ISR (with the interrupts enabled, before EOI), so it must be short
+ * and must not call the functions of the module other than sio_rx_available()
+ * and sio_get_events().
+ * In the framing mode (sio_set_rx_framing()) the ISR signals also the event
+ * SIO_EV_FRAME when it closes a frame. Then \a notify may take the frames
+ * by sio_rx_frames() and sio_recv_frame() (sio_recv_frame_crc()) and send the
+ * response by sio_tx_reserve() and sio_tx_commit(), so the answer leaves
+ * without waiting for the main loop. The program must not take the frames
+ * of the port itself then.
  * \param nport Port number as sio_com_t.
- * \param buf A pointer to an array of bytes.
- * \param len Number of bytes to receive.
+ * \param watermark Number of bytes in the input queue, or 0 to disable.
+ * \param delimiter Delimiter character (0 - 255), or SIO_NO_DELIMITER to disable.
+ * \param notify Callback, or 0.
  * \return -1 on error.
  */
-int sio_recv(sio_com_t nport, char *buf, int len)
+int sio_set_rx_notify(sio_com_t nport, int watermark, int delimiter, sio_notify_t notify)
 {
     if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
         return -1;
     }
 
-    int bytes_readed = 0;
-    int is_block_mode = (F_BLOCK_MODE & uarts[nport]->flags);
-
-    for (;;) {
-
-        _disable();
-
-        // This code is valid for disabling interrupts!!!
-        int bytes_to_read = (uarts[nport]->rx.chars > len) ? (len) : (uarts[nport]->rx.chars);
-
-        if (bytes_to_read) {
-
-            // How many to copy to the ring buffer?
-            // It is on the border of the ring buffer?
-            int sizecpy = ((uarts[nport]->rx.out + bytes_to_read) <=  uarts[nport]->rx.size) ?
-                        (bytes_to_read) : (uarts[nport]->rx.size - uarts[nport]->rx.out);
-
-            // Copy to the boundary of the ring buffer.
-            memcpy(buf, uarts[nport]->rx.data + uarts[nport]->rx.out, sizecpy);
-
-            if (sizecpy < bytes_to_read) { // This is not all?
-                sizecpy = bytes_to_read - sizecpy; // Compute the remainder.
-                uarts[nport]->rx.out = 0; // Beginning of the buffer.
-                // Copy the remainder to the beginning of the ring buffer.
-                memcpy(buf + (bytes_to_read - sizecpy), uarts[nport]->rx.data, sizecpy);
-            }
-
-            uarts[nport]->rx.out += sizecpy; // A pointer to an next empty cell, the ring buffer.
-            uarts[nport]->rx.chars -= bytes_to_read; // Increment number of bytes for transfer.
-
-            // A pointer to an empty cell, the ring buffer outside the buffer size?
-            if (uarts[nport]->rx.out >= uarts[nport]->rx.size) {
-                uarts[nport]->rx.out = 0;
-            }
+    if ((watermark < 0) || (watermark >= uarts[nport]->rx.size)
+            || ((notify || watermark || (SIO_NO_DELIMITER != delimiter)) && (F_RX_LARGE & uarts[nport]->flags))
+            || ((SIO_NO_DELIMITER != delimiter) && ((delimiter < 0) || (delimiter > 0xFF)))) {
+        sioerrno = SIO_ERR_ILLEGAL_SETTING;
+        return -1;
+    }
 
-        }//bytes_to_read > 0
+    _disable();
+    uarts[nport]->rx_watermark = watermark;
+    uarts[nport]->rx_delimiter = delimiter;
+    uarts[nport]->notify = notify;
+    uarts[nport]->events = 0;
+    if (notify || watermark || (SIO_NO_DELIMITER != delimiter)) {
+        uarts[nport]->flags |= F_RX_NOTIFY;
+    } else {
+        uarts[nport]->flags &= ~F_RX_NOTIFY;
+    }
+    _enable();
 
-        _enable();
+    sioerrno = SIO_ERR_NONE;
+    return 0;
+}
 
-        bytes_readed += bytes_to_read;
-        len -= bytes_to_read;
+/*!
+ * Returns and clears the pending RX events of port \a nport.
+ * \param nport Port number as sio_com_t.
+ * \return Events as sio_event_t (you can check them on the AND), or 0 on error.
+ */
+int sio_get_events(sio_com_t nport)
+{
+    if (!uarts[nport]) {
+        return 0;
+    }
+    // The bitmap is updated by the ISR.
+    _disable();
+    int ev = uarts[nport]->events;
+    uarts[nport]->events = 0;
+    _enable();
+    return ev;
+}
 
-        if (is_block_mode) {
-            if (!len) {
-                break;
-            }
-        } else {
-            break;
-        }
+/*!
+ * Resets the statistics of port \a nport.
+ * \param nport Port number as sio_com_t.
+ * \return -1 on error.
+ */
+int sio_reset_stats(sio_com_t nport)
+{
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
     }
-    return bytes_readed;
+    // The counters are updated by the ISR.
+    _disable();
+    memset(&uarts[nport]->stats, 0, sizeof(sio_stats_t));
+    _enable();
+    sioerrno = SIO_ERR_NONE;
+    return 0;
 }
 
 /*!
- * Clears a queue transmitting or receiving of port \a nport
- * depending on a parameter \a dir.
+ * Reads the times of the ISR and of the sections with disabled interrupts
+ * of port \a nport, measured by the counter tio_now().
+ * \note The times are measured only if the module is built with SIO_TRACE.
  * \param nport Port number as sio_com_t.
- * \param dir Direction of the transmit/receive as sio_dir_t (you can install them on the OR).
+ * \param trace Pointer to the structure to which the times are copied.
  * \return -1 on error.
  */
-int sio_clear(sio_com_t nport, sio_dir_t dir)
+int sio_get_trace(sio_com_t nport, sio_trace_t *trace)
 {
-    if (uarts[nport] /*sio_exists(nport)*/ ) {
-        if (SIO_TX_DIRECTION & dir) {
-            uarts[nport]->tx.in = 0;
-            uarts[nport]->tx.out = 0;
-            uarts[nport]->tx.chars = 0;
-        }
-        if (SIO_RX_DIRECTION & dir) {
-            uarts[nport]->rx.in = 0;
-            uarts[nport]->rx.out = 0;
-            uarts[nport]->rx.chars = 0;
-        }
-        return 0;
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
     }
+#ifdef SIO_TRACE
+    // The times are updated by the ISR.
+    _disable();
+    memcpy(trace, &uarts[nport]->trace, sizeof(sio_trace_t));
+    _enable();
+    sioerrno = SIO_ERR_NONE;
+    return 0;
+#else
+    memset(trace, 0, sizeof(sio_trace_t));
+    sioerrno = SIO_ERR_ILLEGAL_SETTING;
     return -1;
+#endif
 }
 
 /*!
- * Returns number of bytes in the port \a nport available to read.
+ * Resets the times of port \a nport.
  * \param nport Port number as sio_com_t.
- * \return Number of bytes available for reading or 0 on error.
+ * \return -1 on error.
  */
-int sio_rx_available(sio_com_t nport)
+int sio_reset_trace(sio_com_t nport)
 {
-    return (uarts[nport]) ? (uarts[nport]->rx.chars) : (0);
+    if (!uarts[nport]) {
+        sioerrno = SIO_ERR_PORT_NOT_OPEN;
+        return -1;
+    }
+#ifdef SIO_TRACE
+    _disable();
+    memset(&uarts[nport]->trace, 0, sizeof(sio_trace_t));
+    _enable();
+    sioerrno = SIO_ERR_NONE;
+    return 0;
+#else
+    sioerrno = SIO_ERR_ILLEGAL_SETTING;
+    return -1;
+#endif
 }
 
 /*!
@@ -878,8 +3795,14 @@ void sio_close(sio_com_t nport)
 
     // Wait end of transfer.
     if (is_block_mode) {
-        while (uarts[nport]->tx.chars > 0) {}
-        while (!(inpw(uarts[SIO_COM_PGM]->addr.lsr) & SIO_LSR_ETHR)) {}
+        while ((uarts[nport]->tx.out != uarts[nport]->tx.in) || uarts[nport]->zc_len
+               || (F_RS485_TX & uarts[nport]->flags)) {
+            if (F_POLLED & uarts[nport]->flags) {
+                port_poll(nport);
+            }
+            rs485_poll(nport);
+        }
+        while (!(inpw(uarts[nport]->addr.lsr) & SIO_LSR_ETHR)) {}
     }
 
     ///sio_clear(nport, SIO_TX_DIRECTION | SIO_RX_DIRECTION);/// ???
@@ -889,7 +3812,9 @@ void sio_close(sio_com_t nport)
         _disable();
         outpw(0xFF28, (inpw(0xFF28) | intmasks[SIO_COM_PGM])); // Disable UART interrupt.
         // Interrupts.
-        _dos_setvect(intnums[SIO_COM_PGM], old_vec_pgm); // Restore old interrupt vector.
+        if (!(F_POLLED & uarts[SIO_COM_PGM]->flags)) {
+            _dos_setvect(intnums[SIO_COM_PGM], old_vec_pgm); // Restore old interrupt vector.
+        }
         // Restore old configuration.
         outpw(uarts[SIO_COM_PGM]->addr.ier, old_ier); // Interrupt enable
         outpw(uarts[SIO_COM_PGM]->addr.mcr, old_brd); // Restore old baud rate.
@@ -901,13 +3826,31 @@ void sio_close(sio_com_t nport)
 #endif
         // Disable UART interrupt.
         outp(uarts[nport]->addr.ier, 0x00);
+        // Disable the RS-485 driver, the transmission could be not finished.
+        if (F_RS485 & uarts[nport]->flags) {
+            _disable();
+            outp(uarts[nport]->addr.mcr, inp(uarts[nport]->addr.mcr) & (~SIO_MCR_FRS));
+            uarts[nport]->flags &= ~F_RS485_TX;
+            _enable();
+        }
+        if (((SIO_COM1 == nport) || (SIO_COM4 == nport)) && (!(F_POLLED & uarts[nport]->flags))) {
+            _disable();
+            shared_remove(&int0, nport);
+            _enable();
+        }
         // Disable FIFO.
         outp(uarts[nport]->addr.iir_fcr, (inpw(uarts[nport]->addr.iir_fcr) & (~SIO_FCR_EF)));
+        // Disable the automatic flow control.
+        if (SIO_UART_16750 == uarts[nport]->type) {
+            outp(uarts[nport]->addr.mcr, inp(uarts[nport]->addr.mcr) & (~SIO_MCR_ACE));
+        } else if (SIO_UART_16C950 == uarts[nport]->type) {
+            efr_write(uarts[nport], 0x00);
+        }
 
         // COM1 and/or COM4
-        if (((SIO_COM1 == nport) && (!uarts[SIO_COM4]))
-                || ((SIO_COM4 == nport) && (!uarts[SIO_COM1]))) {// COM1 open and COM4 not open,
-                                                                 // COM4 open and COM1 not open?
+        if (F_POLLED & uarts[nport]->flags) {
+            // The interrupts have not been used.
+        } else if (((SIO_COM1 == nport) || (SIO_COM4 == nport)) && (0 == int0.cnt)) { // The last UART on INT0?
 
             _disable();
             outpw(0xFF28, (inpw(0xFF28) | intmasks[nport])); // Disable external UART interrupt.
@@ -919,7 +3862,7 @@ void sio_close(sio_com_t nport)
         }
 
         // COM2
-        if (SIO_COM2 == nport) {
+        if ((SIO_COM2 == nport) && (!(F_POLLED & uarts[nport]->flags))) {
 
             _disable();
             outpw(0xFF28, (inpw(0xFF28) | intmasks[nport])); // Disable external UART interrupt.
@@ -933,10 +3876,7 @@ void sio_close(sio_com_t nport)
     }
 #endif
 
-    free(uarts[nport]->tx.data);
-    free(uarts[nport]->rx.data);
-    free(uarts[nport]);
-    uarts[nport] = 0;
+    port_free(nport);
 }
 
 //TEST
@@ -21,6 +21,7 @@ License : New BSD
 #define SIO_H
 
 #include "platformdefs.h"
+#include "../pio/pio.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -70,9 +71,34 @@ typedef enum SIO_ERR {
     SIO_ERR_INVALID_BUFFER_SIZE = 5, /*!< Unsupported buffer size. */
     SIO_ERR_ILLEGAL_SETTING     = 6, /*!< Incorrect configuration parameters. */
     SIO_ERR_UART_NOT_SUPPORTED  = 7, /*!< This type of UART chip is not supported. */
-    SIO_ERR_NOT_MEMORY          = 8  /*!< No memory to create buffers, etc. */
+    SIO_ERR_NOT_MEMORY          = 8, /*!< No memory to create buffers, etc. */
+    SIO_ERR_TIMEOUT             = 9, /*!< Timeout expired. */
+    SIO_ERR_BUSY                = 10 /*!< Previous operation is not finished. */
 } sio_err_t;
 
+/*!
+ * Types of UART chips, detected by sio_open().
+ */
+typedef enum SIO_UART_TYPE {
+    SIO_UART_8250   = 0, /*!< 8250 without the scratch register (not supported). */
+    SIO_UART_16450  = 1, /*!< 16450, without FIFO. */
+    SIO_UART_16550  = 2, /*!< 16550 with the broken FIFO, works without FIFO. */
+    SIO_UART_16550A = 3, /*!< 16550A, 16 byte FIFO. */
+    SIO_UART_16750  = 4, /*!< 16750, 64 byte FIFO and automatic flow control. */
+    SIO_UART_16C950 = 5, /*!< 16C950, works with 16 byte FIFO and automatic flow control. */
+    SIO_UART_PGM    = 6  /*!< Internal UART of the CPU (COM_PGM), without FIFO. */
+} sio_uart_type_t;
+
+/*!
+ * Capabilities of the UART of a port.
+ */
+typedef struct SIO_CAPS {
+    sio_uart_type_t type; /*!< Type of UART. */
+    int rx_fifo;          /*!< Depth of the RX FIFO used, in bytes. */
+    int tx_fifo;          /*!< Depth of the TX FIFO used, in bytes. */
+    int auto_flow;        /*!< Not 0 if the UART has automatic RTS/CTS flow control. */
+} sio_caps_t;
+
 /*!
  * Supported baud rates.
  */
@@ -89,6 +115,26 @@ typedef enum SIO_SPEED {
     SIO_BPS_115200 = 1     /*!< 115200 baud. */
 } sio_speed_t;
 
+/*!
+ * Base rate of sio_speed_t (sio_speed_t is the divisor of it).
+ */
+#define SIO_BAUD_BASE 115200UL
+
+/*!
+ * Default clock of the UARTs 16550, in Hz.
+ */
+#define SIO_CLOCK_UART 1843200UL
+
+/*!
+ * Default clock of the internal UART of the CPU (COM_PGM), in Hz.
+ */
+#define SIO_CLOCK_PGM 40000000UL
+
+/*!
+ * Maximum error of the baud rate for sio_set_baud(), in 0.1%.
+ */
+#define SIO_BAUD_TOLERANCE 30
+
 /*!
  * Supported number of data bits.
  */
@@ -118,14 +164,165 @@ typedef enum SIO_STOPBITS {
     SIO_STOP2 = 0x04  /*!< Two stop bits. */
 } sio_stopbits_t;
 
+/*!
+ * Supported types of flow control.
+ */
+typedef enum SIO_FLOW {
+    SIO_FLOW_NONE   = 0x00, /*!< No flow control. */
+    SIO_FLOW_RTSCTS = 0x01  /*!< Hardware RTS/CTS flow control. */
+} sio_flow_t;
+
 /*!
  * Supported open modes.
+ *
+ * The blocking mode or the non-blocking mode can be combined
+ * with the options on the OR.
  */
 typedef enum SIO_MODE {
-    SIO_BLOCK_MODE = 0, /*!< Blocking mode. */
-    SIO_UNBLOCK_MODE    /*!< Non-blocking mode. */
+    SIO_BLOCK_MODE   = 0x00, /*!< Blocking mode. */
+    SIO_UNBLOCK_MODE = 0x01, /*!< Non-blocking mode. */
+    SIO_POW2_BUFFERS = 0x02, /*!< Option: round up the sizes of the buffers to a power of two,
+                                  so the ISR wraps the ring buffers with a mask. Because one cell
+                                  of the ring buffer always remains empty, request 2^n - 1 bytes
+                                  to get a buffer of 2^n bytes. */
+    SIO_RX_BURST     = 0x04, /*!< Option: on the Received Data Available interrupt read
+                                  (trigger level - 1) bytes from the RX FIFO without polling LSR,
+                                  and poll LSR only for the tail. */
+    SIO_POLLED       = 0x08  /*!< Option: the interrupts of the port are not used,
+                                  the port is served by sio_poll_all(). */
 } sio_mode_t;
 
+/*!
+ * Port statistics.
+ *
+ * The counters are accumulated by the ISR from the moment
+ * when the port is opened or sio_reset_stats() is called.
+ */
+typedef struct SIO_STATS {
+    u32 rx_bytes;        /*!< Number of bytes read from the UART (stored and dropped). */
+    u32 tx_bytes;        /*!< Number of bytes written to the UART. */
+    u32 irqs;            /*!< Number of the interrupts served (all sources). */
+    u32 rx_bursts;       /*!< Number of bursts read from the RX FIFO without polling LSR. */
+    u32 rx_burst_bytes;  /*!< Number of bytes read in the bursts. */
+    u32 rx_polled_bytes; /*!< Number of bytes read with polling LSR. */
+    u32 rx_overruns;     /*!< Number of the overrun errors of the RX FIFO (a byte is lost). */
+    u32 rx_dropped;      /*!< Number of bytes dropped because the input queue is full. */
+    u32 rx_irqs;         /*!< Number of RX interrupts (Received Data Available and time out).
+                              The interrupts per received byte are
+                              rx_irqs / (rx_burst_bytes + rx_polled_bytes). */
+    u32 rx_timeouts;     /*!< Number of Receive Data time out interrupts. */
+    u32 rx_parity_errors;  /*!< Number of the parity errors. */
+    u32 rx_framing_errors; /*!< Number of the framing errors. */
+    u32 rx_breaks;         /*!< Number of the break conditions. */
+    u32 rx_line_errors;    /*!< Number of the errors of the internal UART of COM_PGM,
+                                which are not classified. */
+    u32 rx_echo_bytes;     /*!< Number of bytes of the echo discarded in the RS-485 mode. */
+    u16 rx_peak;           /*!< Peak number of bytes in the input queue. */
+    u16 tx_peak;           /*!< Peak number of bytes in the output queue. */
+    u32 polls;             /*!< Number of the services by sio_poll_all(), which had a work. */
+} sio_stats_t;
+
+/*!
+ * Number of the buckets of the histogram of the times. The bucket 0 counts
+ * the times 0 - 1 us, the bucket i counts the times 2^i - (2^(i+1) - 1) us,
+ * the last bucket counts all longer times.
+ */
+#define SIO_TRACE_BUCKETS 10
+
+/*!
+ * Statistics of the measured times.
+ */
+typedef struct SIO_TRACE_STAT {
+    u16 min;                      /*!< Minimum time, in us. */
+    u16 max;                      /*!< Maximum time, in us. */
+    u32 count;                    /*!< Number of the measurements. */
+    u32 hist[SIO_TRACE_BUCKETS];  /*!< Histogram of the times. */
+} sio_trace_stat_t;
+
+/*!
+ * Times of a port, measured if the module "sio" is built with SIO_TRACE.
+ */
+typedef struct SIO_TRACE_TIMES {
+    sio_trace_stat_t isr;    /*!< Service of the UART by the ISR (the interrupts without a work
+                                  of the shared line are not counted). */
+    sio_trace_stat_t masked; /*!< Sections of the user code with disabled interrupts. */
+} sio_trace_t;
+
+/*!
+ * Value of the RX FIFO trigger level for sio_set_fifo_trigger(),
+ * which means the adaptive trigger level.
+ */
+#define SIO_FIFO_ADAPTIVE 0
+
+/*!
+ * Idle time which closes a frame of Modbus RTU (3.5 characters),
+ * in half characters, for sio_set_rx_framing().
+ */
+#define SIO_FRAME_T35 7
+
+/*!
+ * Initial value of CRC-16 (Modbus) for sio_crc16().
+ */
+#define SIO_CRC16_INIT 0xFFFF
+
+/*!
+ * Size of sio_port_storage_t, in long words.
+ */
+#define SIO_PORT_STORAGE_LONGS 96
+
+/*!
+ * Storage of the port structure for sio_open_static(), the content is private.
+ */
+typedef struct SIO_PORT_STORAGE {
+    long opaque[SIO_PORT_STORAGE_LONGS]; /*!< Private. */
+} sio_port_storage_t;
+
+/*!
+ * Size of one block of the large input queue for sio_set_rx_large(), in bytes.
+ */
+#define SIO_LARGE_BLOCK 0x4000U
+
+/*!
+ * Maximum number of the blocks of the large input queue (1 MB).
+ */
+#define SIO_LARGE_BLOCKS_MAX 64
+
+/*!
+ * Segment of the data for sio_sendv().
+ */
+typedef struct SIO_IOVEC {
+    const void *base; /*!< A pointer to the segment. */
+    int len;          /*!< Length of the segment, in bytes. */
+} sio_iovec_t;
+
+/*!
+ * Completion callback of sio_send_zc(), it is called from the ISR.
+ * \param nport Port number as sio_com_t.
+ * \param buf A pointer to the transferred array of bytes.
+ */
+typedef void (*sio_done_t)(sio_com_t nport, const char *buf);
+
+/*!
+ * RX events.
+ */
+typedef enum SIO_EVENT {
+    SIO_EV_WATERMARK = 0x01, /*!< The input queue has reached the watermark. */
+    SIO_EV_DELIMITER = 0x02, /*!< The delimiter character is received. */
+    SIO_EV_FRAME     = 0x04  /*!< The frame is closed (the framing mode). */
+} sio_event_t;
+
+/*!
+ * Value of the delimiter for sio_set_rx_notify(), which disables it.
+ */
+#define SIO_NO_DELIMITER (-1)
+
+/*!
+ * RX events callback, it is called from the ISR.
+ * \param nport Port number as sio_com_t.
+ * \param events Events as sio_event_t (you can check them on the AND).
+ */
+typedef void (*sio_notify_t)(sio_com_t nport, int events);
+
 /*!
  * Error code.
  *
@@ -136,11 +333,45 @@ typedef enum SIO_MODE {
 extern int sioerrno;
 
 int sio_open(sio_com_t nport, sio_mode_t mode, int tx_buf_size, int rx_buf_size);
+int sio_open_static(sio_com_t nport, sio_mode_t mode, sio_port_storage_t *storage,
+                    char *tx, u16 txsz, char *rx, u16 rxsz);
 int sio_configure(sio_com_t nport, sio_speed_t baud, sio_parity_t parity, sio_databits_t databits, sio_stopbits_t stopbits);
+int sio_set_baud(sio_com_t nport, u32 bps, u32 clock_hz);
+u32 sio_get_baud(sio_com_t nport, int *error);
+int sio_set_flow_control(sio_com_t nport, sio_flow_t flow);
+int sio_set_rs485(sio_com_t nport, int enable);
+u16 sio_get_turnaround(sio_com_t nport);
 int sio_send(sio_com_t nport, const char *buf, int len);
+int sio_send_crc(sio_com_t nport, const char *buf, int len);
+int sio_sendv(sio_com_t nport, const sio_iovec_t *iov, int cnt);
+int sio_send_zc(sio_com_t nport, const char *buf, int len, sio_done_t done);
+int sio_tx_pending(sio_com_t nport);
+int sio_tx_reserve(sio_com_t nport, char **ptr1, int *len1, char **ptr2, int *len2);
+int sio_tx_commit(sio_com_t nport, int n);
 int sio_recv(sio_com_t nport, char *buf, int len);
+int sio_send_timeout(sio_com_t nport, const char *buf, int len, u32 timeout_ms);
+int sio_recv_timeout(sio_com_t nport, char *buf, int len, u32 timeout_ms);
 int sio_clear(sio_com_t nport, sio_dir_t dir);
 int sio_rx_available(sio_com_t nport);
+int sio_set_rx_large(sio_com_t nport, char __far **blocks, int cnt);
+int sio_rx_peek(sio_com_t nport, const char **ptr1, int *len1, const char **ptr2, int *len2);
+int sio_rx_consume(sio_com_t nport, int n);
+int sio_poll_all(void);
+int sio_get_caps(sio_com_t nport, sio_caps_t *caps);
+int sio_get_stats(sio_com_t nport, sio_stats_t *stats);
+int sio_reset_stats(sio_com_t nport);
+int sio_get_trace(sio_com_t nport, sio_trace_t *trace);
+int sio_reset_trace(sio_com_t nport);
+int sio_set_fifo_trigger(sio_com_t nport, int level);
+int sio_get_fifo_trigger(sio_com_t nport);
+int sio_set_rx_framing(sio_com_t nport, int idle_half_chars);
+int sio_rx_frames(sio_com_t nport);
+int sio_recv_frame(sio_com_t nport, char *buf, int size);
+int sio_set_rx_crc(sio_com_t nport, int enable);
+int sio_recv_frame_crc(sio_com_t nport, char *buf, int size, u16 *crc);
+u16 sio_crc16(u16 crc, const char *buf, int len);
+int sio_set_rx_notify(sio_com_t nport, int watermark, int delimiter, sio_notify_t notify);
+int sio_get_events(sio_com_t nport);
 void sio_close(sio_com_t nport);
 
 #ifdef __cplusplus
@@ -0,0 +1,200 @@
+/*********************************************************************************************
+Project :
+Version :
+Date    : 17.10.2026
+Author  :
+Company :
+Comments: A library for work with the timers in your controllers ADAM 5000 series.
+License : New BSD
+**********************************************************************************************/
+
+/*! \file tio.cpp
+ *
+ * Abbreviation of the module (file) "tio" - Timer Input Output.
+ *
+ * This module implements a free-running microsecond counter on the internal
+ * timers of the CPU PLC ADAM 5510. The timers of the CPU are clocked by 1/4 of
+ * the CPU clock: the timer 2 works as a prescaler with the period of 1 us, and
+ * the timer 1 counts the periods of the timer 2 from 0 to 65535 without interrupts.
+ * The timer 0 remains for the operating system.
+ *
+ * The counter wraps every 65.536 ms, so the time intervals are measured as
+ * the difference of two readings in u16, and they must be shorter than the wrap.
+ */
+
+#include "tio.h"
+#include "../pio/pio.h"
+
+
+//--------------------------------------------------------------------------------------------------------//
+/*** Private enums of addresses and of bits of registers ***/
+
+/*!
+ * Addresses of the registers of the timers 1 and 2.
+ */
+typedef enum TIO_ADDR {
+    TIO_T1CNT  = 0xFF58, /*!< Timer 1 Count Register. */
+    TIO_T1CMPA = 0xFF5A, /*!< Timer 1 Maxcount Compare A Register. */
+    TIO_T1CON  = 0xFF5E, /*!< Timer 1 Mode and Control Register. */
+    TIO_T2CNT  = 0xFF60, /*!< Timer 2 Count Register. */
+    TIO_T2CMPA = 0xFF62, /*!< Timer 2 Maxcount Compare A Register. */
+    TIO_T2CON  = 0xFF66  /*!< Timer 2 Mode and Control Register. */
+} tio_addr_t;
+
+/*!
+ * The values of the combinations of bits of the registers TxCON.
+ */
+typedef enum TIO_TCON_B {
+    TIO_TCON_EN   = 0x8000, /*!< Enable counting,                            > 0x0000. */
+    TIO_TCON_INH  = 0x4000, /*!< Inhibit, allows write to the bit EN,        > 0x0000. */
+    TIO_TCON_INT  = 0x2000, /*!< Interrupt on the maximum count,             > 0x0000. */
+    TIO_TCON_RIU  = 0x1000, /*!< Register In Use (compare B),                > 0x0000. */
+    TIO_TCON_MC   = 0x0020, /*!< Maximum Count reached,                      > 0x0000. */
+    TIO_TCON_RTG  = 0x0010, /*!< Retrigger,                                  > 0x0000. */
+    TIO_TCON_P    = 0x0008, /*!< Prescaler, count the maximums of timer 2,   > 0x0000. */
+    TIO_TCON_EXT  = 0x0004, /*!< External clock,                             > 0x0000. */
+    TIO_TCON_ALT  = 0x0002, /*!< Alternate compare registers A and B,        > 0x0000. */
+    TIO_TCON_CONT = 0x0001  /*!< Continuous mode,                            > 0x0000. */
+} tio_tcon_b_t;
+
+#ifdef __WATCOMC__
+/*!
+ * Enables interrupts and halts the CPU until the next interrupt.
+ * The instruction STI delays the interrupts until the end of the next
+ * instruction, so an interrupt between them does not wake up HLT too early.
+ */
+void sti_hlt(void);
+#pragma aux sti_hlt = "sti" "hlt";
+#endif
+
+//--------------------------------------------------------------------------------------------------------//
+/*** Private variables ***/
+
+/*!
+ * Not 0 if the counter is running.
+ */
+static int running = 0;
+/*!
+ * Old state of the timers 1 and 2.
+ */
+static int old_t1con = 0;
+static int old_t1cmpa = 0;
+static int old_t2con = 0;
+static int old_t2cmpa = 0;
+
+//--------------------------------------------------------------------------------------------------------//
+/*** Public functions ***/
+
+/*!
+ * Starts the microsecond counter. Repeated calls do nothing.
+ * \param cpu_clock Clock frequency of the CPU, in Hz, or 0 for TIO_CPU_CLOCK.
+ * \return -1 on error.
+ */
+int tio_init(u32 cpu_clock)
+{
+    if (running) {
+        return 0;
+    }
+
+    if (!cpu_clock) {
+        cpu_clock = TIO_CPU_CLOCK;
+    }
+
+    // Timers are clocked by 1/4 of the CPU clock.
+    u32 prescale = cpu_clock / 4 / 1000000UL;
+    if ((0 == prescale) || (prescale > 0xFFFF)) {
+        return -1;
+    }
+
+    _disable();
+    // Save old timers state.
+    old_t1con = inpw(TIO_T1CON);
+    old_t1cmpa = inpw(TIO_T1CMPA);
+    old_t2con = inpw(TIO_T2CON);
+    old_t2cmpa = inpw(TIO_T2CMPA);
+    // Timer 2: the prescaler with the period of 1 us.
+    outpw(TIO_T2CON, TIO_TCON_INH); // Stop.
+    outpw(TIO_T2CNT, 0);
+    outpw(TIO_T2CMPA, (u16)prescale);
+    outpw(TIO_T2CON, TIO_TCON_EN | TIO_TCON_INH | TIO_TCON_CONT);
+    // Timer 1: counts the periods of timer 2, 0 - 65535.
+    outpw(TIO_T1CON, TIO_TCON_INH); // Stop.
+    outpw(TIO_T1CNT, 0);
+    outpw(TIO_T1CMPA, 0); // 0 means 65536.
+    outpw(TIO_T1CON, TIO_TCON_EN | TIO_TCON_INH | TIO_TCON_P | TIO_TCON_CONT);
+    _enable();
+
+    running = 1;
+    return 0;
+}
+
+/*!
+ * Returns the current value of the microsecond counter.
+ * \return Microseconds, modulo 65536.
+ */
+u16 tio_now(void)
+{
+    return inpw(TIO_T1CNT);
+}
+
+/*!
+ * Starts the deadline \a d, which expires after \a timeout_ms.
+ * \param d Pointer to the deadline.
+ * \param timeout_ms Timeout, in ms.
+ */
+void tio_deadline(tio_deadline_t *d, u32 timeout_ms)
+{
+    d->last = tio_now();
+    d->elapsed = 0;
+    d->timeout = (timeout_ms < 4000000UL) ? (timeout_ms * 1000UL) : (4000000000UL);
+}
+
+/*!
+ * Checks the deadline \a d.
+ * \param d Pointer to the deadline.
+ * \return Not 0 if the deadline is expired.
+ */
+int tio_expired(tio_deadline_t *d)
+{
+    u16 now = tio_now();
+    d->elapsed += (u16)(now - d->last);
+    d->last = now;
+    return (d->elapsed >= d->timeout);
+}
+
+/*!
+ * Waits for the next interrupt with the CPU halted.
+ *
+ * The function must be called with the interrupts disabled after a check
+ * of the waited condition, it enables them. So the interrupt, which changes
+ * the condition after the check, just wakes up the CPU.
+ */
+void tio_idle(void)
+{
+#ifdef __WATCOMC__
+    sti_hlt();
+#else
+    _enable();
+#endif
+}
+
+/*!
+ * Stops the microsecond counter and restores old state of the timers.
+ */
+void tio_close(void)
+{
+    if (!running) {
+        return;
+    }
+
+    _disable();
+    outpw(TIO_T1CON, TIO_TCON_INH); // Stop.
+    outpw(TIO_T2CON, TIO_TCON_INH); // Stop.
+    outpw(TIO_T1CMPA, old_t1cmpa);
+    outpw(TIO_T2CMPA, old_t2cmpa);
+    outpw(TIO_T1CON, old_t1con | TIO_TCON_INH);
+    outpw(TIO_T2CON, old_t2con | TIO_TCON_INH);
+    _enable();
+
+    running = 0;
+}
@@ -0,0 +1,56 @@
+/*********************************************************************************************
+Project :
+Version :
+Date    : 17.10.2026
+Author  :
+Company :
+Comments: A library for work with the timers in your controllers ADAM 5000 series.
+License : New BSD
+**********************************************************************************************/
+
+/*! \file tio.h
+ *
+ * Abbreviation of the module (file) "tio" - Timer Input Output.
+ *
+ * This is the header file for the module implementation "tio.cpp".
+ * This header file is declared interface to the free-running microsecond
+ * counter built on the internal timers of the CPU (Am188ES) PLC ADAM 5510.
+ */
+
+#ifndef TIO_H
+#define TIO_H
+
+#include "platformdefs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * Default clock frequency of the CPU PLC ADAM 5510, in Hz.
+ */
+#define TIO_CPU_CLOCK 40000000UL
+
+/*!
+ * Deadline, measured by the microsecond counter.
+ *
+ * The counter wraps every 65.536 ms, so tio_expired() must be called
+ * more often (the system timer tick wakes the CPU every 55 ms).
+ */
+typedef struct TIO_DEADLINE {
+    u16 last;    /*!< Last reading of the counter. */
+    u32 elapsed; /*!< Elapsed time, in us. */
+    u32 timeout; /*!< Timeout, in us. */
+} tio_deadline_t;
+
+int tio_init(u32 cpu_clock);
+u16 tio_now(void);
+void tio_deadline(tio_deadline_t *d, u32 timeout_ms);
+int tio_expired(tio_deadline_t *d);
+void tio_idle(void);
+void tio_close(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // TIO_H
@@ -28,6 +28,14 @@ typedef unsigned long u32;
 typedef char s8;
 typedef short s16;
 typedef long s32;
+#elif defined (__GNUC__) // Host builds of the tests and benchmarks.
+typedef unsigned char u8;
+typedef unsigned short u16;
+typedef unsigned int u32;
+
+typedef char s8;
+typedef short s16;
+typedef int s32;
 #else
 #  error "Your compiler is not supported. Please add it to platformdefs.h"
 #endif
@@ -0,0 +1,146 @@
+/*
+ * Host benchmark of the ISR of the module "sio".
+ *
+ * The module "sio" is built on the host (Linux) with the port I/O simulator of the
+ * module "pio", and the port I/O goes to the simulated 16550 UART of COM1.
+ * The bytes are received at 115200 bps in messages of 20 bytes with a pause of
+ * 10 characters, the simulated UART raises the RX interrupts by the programmed
+ * trigger level and by the Character Timeout, and the benchmark calls the
+ * installed interrupt handler directly when the UART requests it. It measures
+ * the cycles and the number of port accesses per byte, for the
+ * ordinary ring buffers, for the ring buffers with the size of a power of two,
+ * with the burst reading of the RX FIFO and with the other trigger levels.
+ *
+ * Build and run:
+ *   g++ -O2 -I../../../src -I../../../src/io/sio -I../../../src/io/pio main.cpp \
+ *       ../../../src/io/sio/sio.cpp ../../../src/io/tio/tio.cpp ../../../src/io/pio/piosim.cpp -o bench
+ *   ./bench
+ */
+
+#include "sio.h"
+#include "piosim.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if defined (__i386__) || defined (__x86_64__)
+#include <x86intrin.h>
+#endif
+
+//---------------------------------------------------------------------------------
+
+static unsigned long long cycles(void)
+{
+#if defined (__i386__) || defined (__x86_64__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static void bench(const char *name, sio_mode_t mode, int trigger)
+{
+    enum {
+        BYTES = 1000000,
+        MESSAGE = 20,  // Bytes of one message.
+        PAUSE = 10,    // Pause after the message, in characters.
+        CHAR_US = 87   // Time of one character at 115200 bps, 8N1.
+    };
+
+    char buf[1024];
+
+    piosim_reset();
+    if (-1 == sio_open(SIO_COM1, mode, 1023, 1023)) {
+        printf("sio_open() error %d\n", sioerrno);
+        return;
+    }
+    sio_configure(SIO_COM1, SIO_BPS_115200, SIO_PAR_NONE, SIO_DATA8, SIO_STOP1);
+    sio_set_fifo_trigger(SIO_COM1, trigger);
+    pio_vect_t isr = _dos_getvect(0x0C);
+    pio_stats_t io;
+
+    // Receive.
+    unsigned long long rx_cycles = 0;
+    pio_reset_stats();
+    for (long n = 0; n < BYTES; ) {
+        for (int i = 0; i < (MESSAGE + PAUSE); ++i) {
+            piosim_advance(CHAR_US);
+            if (i < MESSAGE) {
+                unsigned char c = (unsigned char)n++;
+                piosim_rx_inject(PIOSIM_COM1, &c, 1);
+            }
+            if (piosim_pending(PIOSIM_COM1)) {
+                unsigned long long t = cycles();
+                isr();
+                rx_cycles += cycles() - t;
+            }
+        }
+        if (sio_rx_available(SIO_COM1) > 512) {
+            sio_recv(SIO_COM1, buf, sio_rx_available(SIO_COM1));
+        }
+    }
+    pio_get_stats(&io);
+    unsigned long rx_ports = io.reads + io.writes;
+    unsigned long rx_clocks = io.clocks;
+    sio_clear(SIO_COM1, SIO_RX_DIRECTION);
+    sio_stats_t stats;
+    sio_get_stats(SIO_COM1, &stats);
+    int last_trigger = sio_get_fifo_trigger(SIO_COM1);
+
+    // Transmit.
+    unsigned long long tx_cycles = 0;
+    memset(buf, 0x55, sizeof(buf));
+    u32 tx_base = piosim_tx_count(PIOSIM_COM1);
+    pio_reset_stats();
+    while ((piosim_tx_count(PIOSIM_COM1) - tx_base) < BYTES) {
+        sio_send(SIO_COM1, buf, 1000);
+        while ((piosim_tx_count(PIOSIM_COM1) - tx_base) < BYTES) {
+            piosim_tx_ready(PIOSIM_COM1);
+            unsigned long long t = cycles();
+            isr();
+            tx_cycles += cycles() - t;
+            if (0 == ((piosim_tx_count(PIOSIM_COM1) - tx_base) % 1000)) {
+                break;
+            }
+        }
+    }
+    pio_get_stats(&io);
+    unsigned long tx_ports = io.reads + io.writes;
+    unsigned long tx_clocks = io.clocks;
+    unsigned long tx_bytes = piosim_tx_count(PIOSIM_COM1) - tx_base;
+    sio_clear(SIO_COM1, SIO_TX_DIRECTION);
+
+    sio_close(SIO_COM1);
+
+    printf("%-12s RX: %6.2f cycles/byte, %5.2f port I/O/byte; TX: %6.2f cycles/byte, %5.2f port I/O/byte\n",
+           name,
+           (double)rx_cycles / BYTES, (double)rx_ports / BYTES,
+           (double)tx_cycles / tx_bytes, (double)tx_ports / tx_bytes);
+    printf("%-12s RX: %lu bursts, %lu burst bytes, %lu polled bytes, %lu overruns, %lu dropped\n",
+           "",
+           (unsigned long)stats.rx_bursts, (unsigned long)stats.rx_burst_bytes,
+           (unsigned long)stats.rx_polled_bytes, (unsigned long)stats.rx_overruns,
+           (unsigned long)stats.rx_dropped);
+    printf("%-12s RX: %.3f interrupts/byte, %lu timeouts, trigger level %d\n",
+           "",
+           (double)stats.rx_irqs / (stats.rx_burst_bytes + stats.rx_polled_bytes),
+           (unsigned long)stats.rx_timeouts, last_trigger);
+    printf("%-12s RX: %.1f port I/O clocks/byte of Am188ES; TX: %.1f port I/O clocks/byte of Am188ES\n",
+           "", (double)rx_clocks / BYTES, (double)tx_clocks / tx_bytes);
+    printf("%-12s RX: %lu bytes, %lu interrupts served, peak %u bytes in the queue\n",
+           "",
+           (unsigned long)stats.rx_bytes, (unsigned long)stats.irqs, (unsigned)stats.rx_peak);
+}
+
+int main(void)
+{
+    bench("default", SIO_BLOCK_MODE, 14);
+    bench("pow2", (sio_mode_t)(SIO_BLOCK_MODE | SIO_POW2_BUFFERS), 14);
+    bench("burst", (sio_mode_t)(SIO_BLOCK_MODE | SIO_RX_BURST), 14);
+    bench("pow2+burst", (sio_mode_t)(SIO_BLOCK_MODE | SIO_POW2_BUFFERS | SIO_RX_BURST), 14);
+    bench("trigger 1", SIO_BLOCK_MODE, 1);
+    bench("adaptive", SIO_BLOCK_MODE, SIO_FIFO_ADAPTIVE);
+    return 0;
+}